@@ -0,0 +1,15 @@
+#include "fir.h"
+#include <cmath>
+void fir_gen( int, int n, double fs, double fc, double* h, double*, double* )
+{
+	const double PI = 4*std::atan(1);
+	double s = 0;
+	for ( int i = 0; i < n; i++ ) {
+		double m = i - (n-1)/2.;
+		double x = 2*fc/fs;
+		double v = m == 0 ? x : std::sin(PI*x*m)/(PI*m);
+		double w = 0.42 - 0.5*std::cos(2*PI*i/(n-1)) + 0.08*std::cos(4*PI*i/(n-1));
+		h[i] = v*w; s += h[i];
+	}
+	for ( int i = 0; i < n; i++ ) h[i] /= s;
+}
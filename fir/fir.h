@@ -0,0 +1,6 @@
+// local build stub standing in for the fir submodule (not committed)
+#ifndef FIR_H
+#define FIR_H
+enum { RECTANGULAR_WINDOW_TYPE, HAMMING_WINDOW_TYPE, BLACKMAN_WINDOW_TYPE };
+void fir_gen( int window_type, int nb_coef, double sample_rate, double cutoff_frequency, double* coef, double* a, double* b );
+#endif
@@ -0,0 +1,401 @@
+/*
+  ===========================================================================
+
+  Copyright (C) 2018 Emvivre
+
+  This file is part of IQ_BENCH.
+
+  IQ_BENCH is free software: you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation, either version 3 of the License, or
+  (at your option) any later version.
+
+  IQ_BENCH is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with IQ_BENCH.  If not, see <http://www.gnu.org/licenses/>.
+
+  ===========================================================================
+*/
+
+/*
+  Throughput of every program of the toolbox, for each data format and
+  signal type. The programs are compiled in here (iq_programs.h) and run
+  with their usual options on a synthetic signal held in memory: their
+  input is served in place by io_view(), their output counted and thrown
+  away, so that no pipe nor file is involved.
+
+  Each case is run NB_WARMUP times, then NB_RUN times measured. The
+  time per input sample (a frame of I/Q pairs) is reported as its
+  minimum, median, mean and standard deviation, with the throughput and
+  the TSC cycles of the median run. The results are also written to
+  OUTPUT_FILE, one case per line, to be compared across commits.
+*/
+
+#include <fstream>
+#include <sstream>
+#include <iomanip>
+#include <chrono>
+#include "iq_programs.h"
+
+/* the synthetic input of a run, read in place */
+class bench_source : public io_endpoint
+{
+public:
+	bench_source( const std::vector<char>& data ) : data( data ), pos( 0 ) {}
+
+	size_t read( void* buf, size_t len )
+	{
+		size_t got;
+		const void* p = view( buf, len, got );
+		std::memcpy( buf, p, got );
+		return got;
+	}
+
+	const void* view( void*, size_t len, size_t& got )
+	{
+		got = std::min( len, data.size() - pos );
+		const char* p = &data[ pos ];
+		pos += got;
+		return p;
+	}
+
+	unsigned long long remaining() { return data.size() - pos; }
+	bool write( const void*, size_t ) { return false; }
+	void flush() {}
+
+private:
+	const std::vector<char>& data;
+	size_t pos;
+};
+
+class bench_sink : public io_endpoint
+{
+public:
+	bench_sink() : len( 0 ) {}
+	size_t read( void*, size_t ) { return 0; }
+	bool write( const void*, size_t size ) { len += size; return true; }
+	void flush() {}
+
+	unsigned long long len;
+};
+
+/* a tone at a tenth of the sample rate on each channel, at half the full scale, with a little noise */
+template <class T>
+std::vector<char> bench_signal( unsigned int nb_chan, unsigned int nb_sample )
+{
+	const double full_scale = std::numeric_limits<T>::is_integer ? (double) std::numeric_limits<T>::max() : 1.;
+	const double PI = 4 * std::atan(1);
+	std::vector<T> x( nb_chan * nb_sample );
+	unsigned int seed = 1;
+	for ( unsigned int i = 0; i < nb_sample; i++ ) {
+		for ( unsigned int c = 0; c < nb_chan; c++ ) {
+			seed = seed * 1103515245 + 12345;
+			const double noise = ( ( seed >> 16 ) & 0x7fff ) / 32768. - 0.5;
+			x[ nb_chan * i + c ] = full_scale * ( 0.5 * std::cos( 2 * PI * 0.1 * i - c * PI / 2 ) + 0.01 * noise );
+		}
+	}
+	std::vector<char> data( x.size() * sizeof(T) );
+	std::memcpy( &data[0], (const void*) &x[0], data.size() );
+	return data;
+}
+
+static std::vector<char> bench_signal( const std::string& data_format, unsigned int nb_chan, unsigned int nb_sample )
+{
+	if      ( data_format == "i8"  ) { return bench_signal<char>( nb_chan, nb_sample ); }
+	else if ( data_format == "u8"  ) { return bench_signal<u8_sample>( nb_chan, nb_sample ); }
+	else if ( data_format == "i16" ) { return bench_signal<short>( nb_chan, nb_sample ); }
+	else if ( data_format == "i32" ) { return bench_signal<int>( nb_chan, nb_sample ); }
+	else if ( data_format == "f16" ) { return bench_signal<f16_sample>( nb_chan, nb_sample ); }
+	else if ( data_format == "f32" ) { return bench_signal<float>( nb_chan, nb_sample ); }
+	return bench_signal<double>( nb_chan, nb_sample );
+}
+
+/*
+  The options of each program, SIGNAL_TYPES being the values given to -t
+  (none: the program has no -t, its input being scalar or iq as given by
+  the type). A program is benched once per VARIANT of its options, the
+  variant being appended to its name in the results, on the
+  DATA_FORMATS the options accept (all of them when empty). With
+  FILE_INPUT, the program reads a regular file instead of a stream, the
+  global normalization mapping its input.
+*/
+struct bench_program
+{
+	const char* name;
+	const char* variant;
+	const char* options;
+	const char* signal_types;
+	const char* data_formats;
+	bool file_input;
+};
+
+static const bench_program BENCH_PROGRAMS[] = {
+	{ "iq_channelize", "", "-s 1000000 -M 8 -c 1:-", "none:iq", "", false },
+	{ "iq_conv", "", "-D f32", "none:scalar", "", false },
+	{ "iq_decimate", "", "-s 1000000 -f 100000", "scalar iq", "", false },
+	{ "iq_decimate", "direct", "-s 1000000 -f 100000 -e direct", "scalar iq", "", false },
+	{ "iq_decimate", "fft", "-s 1000000 -f 100000 -e fft", "scalar iq", "", false },
+	{ "iq_decimate", "cascade", "-s 1000000 -f 100000 -e cascade", "scalar iq", "", false },
+	{ "iq_decimate", "f32", "-s 1000000 -f 100000 -e direct -p f32", "scalar iq", "", false },
+	{ "iq_decimate", "q15", "-s 1000000 -f 100000 -e direct -p q15", "scalar iq", "i8 u8 i16", false },
+	{ "iq_decimate", "ddc", "-s 1000000 -f 100000 -e direct -m 200000", "iq", "", false },
+	{ "iq_deemphasis", "", "-s 1000000", "scalar iq", "", false },
+	{ "iq_demodfreq", "", "-s 1000000", "none:iq", "", false },
+	{ "iq_demodfreq", "fast", "-s 1000000 -a fast", "none:iq", "", false },
+	{ "iq_demodfreq", "accurate", "-s 1000000 -a accurate", "none:iq", "", false },
+	{ "iq_filter", "", "-s 1000000 -f 100000", "scalar iq", "", false },
+	{ "iq_iir", "", "-s 1000000 -p lowpass -f 100000 -n 4", "scalar iq", "", false },
+	{ "iq_mix", "", "-s 1000000 -m 1000", "none:iq", "", false },
+	{ "iq_modfreq", "", "", "none:scalar", "", false },
+	{ "iq_normalize", "", "-m 1", "scalar iq", "", false },
+	{ "iq_normalize", "peak", "-m 1 -a peak", "scalar iq", "", false },
+	{ "iq_normalize", "rms", "-m 1 -a rms", "scalar iq", "", false },
+	{ "iq_normalize", "global", "-m 1 -a global", "scalar iq", "", true },
+	{ "iq_phasis", "", "", "none:iq", "", false },
+	{ "iq_phasis", "fast", "-a fast", "none:iq", "", false },
+	{ "iq_phasis", "accurate", "-a accurate", "none:iq", "", false },
+	{ "iq_preemphasis", "", "-s 1000000", "scalar iq", "", false },
+	{ "iq_resample", "", "-s 1000000 -S 48000", "scalar iq", "", false }
+};
+static const int NB_BENCH_PROGRAM = sizeof(BENCH_PROGRAMS) / sizeof(*BENCH_PROGRAMS);
+
+static const char* BENCH_FORMATS[] = { "i8", "u8", "i16", "i32", "f16", "f32", "f64" };
+static const int NB_BENCH_FORMAT = sizeof(BENCH_FORMATS) / sizeof(*BENCH_FORMATS);
+
+static uint64_t bench_cycles()
+{
+#if defined(__x86_64__) || defined(__i386__)
+	return __rdtsc();
+#else
+	return 0;
+#endif
+}
+
+struct bench_run
+{
+	double ns;       /* per input sample */
+	double cycles;   /* per input sample */
+	int result;
+	unsigned long long output_len;
+};
+
+static bench_run bench_once( int (*program_main)( int, char** ), std::vector<std::string> args, const std::vector<char>& input, unsigned int nb_sample, FILE* fd_input, FILE* fd_output )
+{
+	std::vector<char*> argv;
+	for ( unsigned int a = 0; a < args.size(); a++ ) {
+		argv.push_back( &args[ a ][0] );
+	}
+	argv.push_back( NULL );
+	bench_source source( input );
+	bench_sink sink;
+	io_attach( fd_input, &source );
+	io_attach( fd_output, &sink );
+	stage_stdin = fd_input;
+	stage_stdout = fd_output;
+	const std::chrono::steady_clock::time_point t0 = std::chrono::steady_clock::now();
+	const uint64_t c0 = bench_cycles();
+	bench_run r;
+	r.result = program_main( args.size(), &argv[0] );
+	const uint64_t c1 = bench_cycles();
+	const std::chrono::steady_clock::time_point t1 = std::chrono::steady_clock::now();
+	io_detach( fd_input );
+	io_detach( fd_output );
+	r.ns = std::chrono::duration<double, std::nano>( t1 - t0 ).count() / nb_sample;
+	r.cycles = double( c1 - c0 ) / nb_sample;
+	r.output_len = sink.len;
+	return r;
+}
+
+static std::vector<std::string> bench_words( const char* text )
+{
+	std::istringstream words( text );
+	std::vector<std::string> r;
+	std::string word;
+	while ( words >> word ) {
+		r.push_back( word );
+	}
+	return r;
+}
+
+/* every name is selected by an empty selection */
+static bool bench_selected( const std::vector<std::string>& selection, const std::string& name )
+{
+	return selection.empty() || std::find( selection.begin(), selection.end(), name ) != selection.end();
+}
+
+int main(int argc, char** argv)
+{
+	const std::string prog_name = argv[0];
+	std::vector<std::string> programs;
+	std::vector<std::string> data_formats;
+	unsigned int nb_sample = 1 << 20;
+	int nb_warmup = 1;
+	int nb_run = 5;
+	std::string output_file = "bench_output.txt";
+	for ( int i = 1; i < argc; i += 2 ) {
+		std::string arg = argv[i];
+		if ( i + 1 == argc || arg == "-h" ) {
+			std::cerr << "Usage: " << argv[0] << " <OPTIONS>\n"
+				"  -p <PROGRAM> : this program only, can be repeated (default: all)\n"
+				"  -d <DATA_FORMAT> : i8 | u8 | i16 | i32 | f16 | f32 | f64, can be repeated (default: all)\n"
+				"  -n <NB_SAMPLE> : input samples of each run (default: 1048576)\n"
+				"  -w <NB_WARMUP> : runs before the measured ones (default: 1)\n"
+				"  -r <NB_RUN> : measured runs (default: 5)\n"
+				"  -o <OUTPUT_FILE> : one line per case, - for none (default: bench_output.txt)\n";
+			return 1;
+		}
+		if ( arg == "-p" ) {
+			std::string name = argv[i+1];
+			programs.push_back( name.compare( 0, 3, "iq_" ) == 0 ? name : "iq_" + name );
+		} else if ( arg == "-d" ) {
+			data_formats.push_back( argv[i+1] );
+		} else if ( arg == "-n" ) {
+			nb_sample = atof( argv[i+1] );
+		} else if ( arg == "-w" ) {
+			nb_warmup = atoi( argv[i+1] );
+		} else if ( arg == "-r" ) {
+			nb_run = atoi( argv[i+1] );
+		} else if ( arg == "-o" ) {
+			output_file = argv[i+1];
+		}
+	}
+	if ( nb_sample == 0 ) {
+		std::cerr << prog_name << " : ERROR: please set a valid number of samples !\n";
+		return 1;
+	}
+	if ( nb_warmup < 0 || nb_run <= 0 ) {
+		std::cerr << prog_name << " : ERROR: please set a valid number of runs !\n";
+		return 1;
+	}
+	for ( unsigned int p = 0; p < programs.size(); p++ ) {
+		int k = 0;
+		while ( k < NB_BENCH_PROGRAM && programs[ p ] != BENCH_PROGRAMS[ k ].name ) {
+			k++;
+		}
+		if ( k == NB_BENCH_PROGRAM ) {
+			std::cerr << prog_name << " : ERROR: please set a valid program instead of " << programs[ p ] << " !\n";
+			return 1;
+		}
+	}
+	for ( unsigned int d = 0; d < data_formats.size(); d++ ) {
+		if ( std::find( BENCH_FORMATS, BENCH_FORMATS + NB_BENCH_FORMAT, data_formats[ d ] ) == BENCH_FORMATS + NB_BENCH_FORMAT ) {
+			std::cerr << prog_name << " : ERROR: please set a valid data format !\n";
+			return 1;
+		}
+	}
+	std::ofstream output;
+	if ( output_file != "-" ) {
+		output.open( output_file.c_str() );
+		if ( !output ) {
+			std::cerr << prog_name << " : ERROR: cannot write " << output_file << " !\n";
+			return 1;
+		}
+		output << "# program format type samples runs ns_min ns_median ns_mean ns_stddev msamples_per_s cycles_per_sample output_bytes\n";
+	}
+	FILE* fd_input = fopen( "/dev/null", "rb" );
+	FILE* fd_output = fopen( "/dev/null", "wb" );
+	if ( fd_input == NULL || fd_output == NULL ) {
+		std::cerr << prog_name << " : ";
+		perror("fopen()");
+		return 1;
+	}
+	std::cout << std::left << std::setw( 24 ) << "program" << std::setw( 8 ) << "format" << std::setw( 8 ) << "type"
+		<< std::right << std::setw( 10 ) << "Msample/s" << std::setw( 10 ) << "ns/sample" << std::setw( 10 ) << "+-"
+		<< std::setw( 14 ) << "cycles/sample" << "\n";
+	int result = 0;
+	for ( int k = 0; k < NB_BENCH_PROGRAM; k++ ) {
+		const bench_program& b = BENCH_PROGRAMS[ k ];
+		if ( !bench_selected( programs, b.name ) ) {
+			continue;
+		}
+		const std::string label = ( *b.variant != '\0' ) ? std::string( b.name ) + ":" + b.variant : b.name;
+		int s = 0;
+		while ( s < NB_STAGE_PROGRAM && std::string( b.name ) != STAGE_PROGRAMS[ s ].name ) {
+			s++;
+		}
+		std::istringstream signal_types( b.signal_types );
+		std::string signal_type;
+		while ( signal_types >> signal_type ) {
+			const bool fixed = ( signal_type.compare( 0, 5, "none:" ) == 0 );
+			const std::string type = fixed ? signal_type.substr( 5 ) : signal_type;
+			const unsigned int nb_chan = ( type == "iq" ) ? 2 : 1;
+			for ( int f = 0; f < NB_BENCH_FORMAT; f++ ) {
+				const std::string data_format = BENCH_FORMATS[ f ];
+				if ( !bench_selected( data_formats, data_format ) || !bench_selected( bench_words( b.data_formats ), data_format ) ) {
+					continue;
+				}
+				std::vector<std::string> args;
+				args.push_back( b.name );
+				std::istringstream options( b.options );
+				std::string option;
+				while ( options >> option ) {
+					args.push_back( option );
+				}
+				args.push_back( "-d" );
+				args.push_back( data_format );
+				if ( !fixed ) {
+					args.push_back( "-t" );
+					args.push_back( type );
+				}
+				const std::vector<char> input = bench_signal( data_format, nb_chan, nb_sample );
+				FILE* fd_file = NULL;
+				if ( b.file_input ) {
+					fd_file = tmpfile();
+					if ( fd_file == NULL || fwrite( &input[0], 1, input.size(), fd_file ) != input.size() || fflush( fd_file ) != 0 ) {
+						std::cerr << prog_name << " : ";
+						perror("tmpfile()");
+						return 1;
+					}
+				}
+				/* the programs report their settings on std::cerr, kept for the failures */
+				std::ostringstream messages;
+				std::streambuf* cerr_buf = std::cerr.rdbuf( messages.rdbuf() );
+				std::vector<bench_run> runs;
+				bool failed = false;
+				for ( int r = 0; r < nb_warmup + nb_run && !failed; r++ ) {
+					if ( fd_file != NULL ) {
+						rewind( fd_file );
+					}
+					const bench_run run = bench_once( STAGE_PROGRAMS[ s ].main, args, input, nb_sample, fd_file != NULL ? fd_file : fd_input, fd_output );
+					failed = ( run.result != 0 );
+					if ( r >= nb_warmup ) {
+						runs.push_back( run );
+					}
+				}
+				std::cerr.rdbuf( cerr_buf );
+				if ( fd_file != NULL ) {
+					fclose( fd_file );
+				}
+				std::cout << std::left << std::setw( 24 ) << label << std::setw( 8 ) << data_format << std::setw( 8 ) << type << std::right;
+				if ( failed ) {
+					std::cout << " failed\n";
+					std::cerr << messages.str();
+					result = 1;
+					continue;
+				}
+				std::sort( runs.begin(), runs.end(), []( const bench_run& x, const bench_run& y ) { return x.ns < y.ns; } );
+				const bench_run& median = runs[ runs.size() / 2 ];
+				double mean = 0, var = 0;
+				for ( unsigned int r = 0; r < runs.size(); r++ ) {
+					mean += runs[ r ].ns / runs.size();
+				}
+				for ( unsigned int r = 0; r < runs.size(); r++ ) {
+					var += ( runs[ r ].ns - mean ) * ( runs[ r ].ns - mean ) / runs.size();
+				}
+				const double stddev = std::sqrt( var );
+				std::cout << std::fixed << std::setprecision( 2 ) << std::setw( 10 ) << 1e3 / median.ns << std::setw( 10 ) << median.ns
+					<< std::setw( 10 ) << stddev << std::setw( 14 ) << median.cycles << "\n" << std::defaultfloat;
+				if ( output.is_open() ) {
+					output << label << " " << data_format << " " << type << " " << nb_sample << " " << runs.size() << " "
+						<< runs.front().ns << " " << median.ns << " " << mean << " " << stddev << " "
+						<< 1e3 / median.ns << " " << median.cycles << " " << median.output_len << "\n";
+				}
+			}
+		}
+	}
+	return result;
+}
@@ -0,0 +1,599 @@
+/*
+  ===========================================================================
+
+  Copyright (C) 2018 Emvivre
+
+  This file is part of IQ_TOOLBOX.
+
+  IQ_TOOLBOX is free software: you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation, either version 3 of the License, or
+  (at your option) any later version.
+
+  IQ_TOOLBOX is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with IQ_TOOLBOX.  If not, see <http://www.gnu.org/licenses/>.
+
+  ===========================================================================
+*/
+
+#ifndef IQ_CAPTURE_H
+#define IQ_CAPTURE_H
+
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <cmath>
+#include <string>
+#include <vector>
+#include <algorithm>
+#include <iostream>
+#include <mutex>
+#include <errno.h>
+#include <stdint.h>
+#include "iq_f16.h"
+#include "iq_io.h"
+
+/*
+  Compressed capture container, used for the capture files named *.iqz,
+  every other file being opened as a raw stream. The samples are cut into
+  independent blocks of IQZ_BLOCK_LEN samples:
+
+    header  : "IQZ1", format, sample size, 2 reserved bytes, block length
+              in samples (u32), quantization step (f64)
+    blocks  : raw bytes (u32), stored bytes (u32), type (u8), payload
+    end     : a block of 0 raw bytes
+    index   : file offset of each block (u64)
+    trailer : index offset, number of blocks, raw bytes (u64 each), "IQZI"
+
+  Integer samples are predicted by the previous sample of the same
+  channel, the I/Q channels being interleaved, then the zigzag coded
+  residuals are bit packed by groups of IQZ_GROUP_LEN with one width byte
+  per group. Float samples are stored as they are, unless a quantization
+  step is given to the writer by a ":STEP" suffix of the file name
+  (e.g. capture.iqz:1e-4): they are then rounded to a multiple of it and
+  packed like integers. A block whose packing is not smaller is stored raw.
+  The index gives the offset of any block, hence O(1) seeks.
+*/
+static const uint32_t IQZ_BLOCK_LEN = 65536;
+static const unsigned int IQZ_GROUP_LEN = 64;
+static const unsigned int IQZ_HEADER_SIZE = 24;
+static const unsigned int IQZ_RECORD_SIZE = 9;
+static const unsigned int IQZ_TRAILER_SIZE = 28;
+
+enum iqz_block_type { IQZ_RAW = 0, IQZ_PACKED = 1 };
+
+struct iqz_format
+{
+	const char* name;
+	unsigned int size;
+	bool integer;
+	bool floating;
+};
+
+static const iqz_format IQZ_FORMATS[] = {
+	{ "i8", 1, true, false }, { "u8", 1, true, false }, { "i16", 2, true, false }, { "i32", 4, true, false },
+	{ "f16", 2, false, true }, { "f32", 4, false, true }, { "f64", 8, false, true }, { "sc12", 1, false, false }
+};
+static const int IQZ_NB_FORMAT = sizeof(IQZ_FORMATS) / sizeof(*IQZ_FORMATS);
+
+/* bit packing of the zigzag residuals of x[ i ] - x[ i-2 ], modulo the lane width */
+template <class U>
+void iqz_pack( const U* x, unsigned int n, std::vector<unsigned char>& out )
+{
+	const int bits = 8 * sizeof(U);
+	U prev[ 2 ] = { 0, 0 };
+	U z[ IQZ_GROUP_LEN ];
+	for ( unsigned int g = 0; g < n; g += IQZ_GROUP_LEN ) {
+		U all = 0;
+		for ( unsigned int j = 0; j < IQZ_GROUP_LEN; j++ ) {
+			const unsigned int i = g + j;
+			if ( i < n ) {
+				const U d = x[ i ] - prev[ i & 1 ];
+				prev[ i & 1 ] = x[ i ];
+				z[ j ] = U( d << 1 ) ^ U( -( d >> ( bits - 1 ) ) );
+			} else {
+				z[ j ] = 0;
+			}
+			all |= z[ j ];
+		}
+		unsigned int w = 0;
+		while ( w < (unsigned int) bits && ( all >> w ) != 0 ) {
+			w++;
+		}
+		out.push_back( w );
+		uint64_t acc = 0;
+		unsigned int nb_bit = 0;
+		for ( unsigned int j = 0; j < IQZ_GROUP_LEN; j++ ) {
+			acc |= uint64_t( z[ j ] ) << nb_bit;
+			nb_bit += w;
+			while ( nb_bit >= 8 ) {
+				out.push_back( acc );
+				acc >>= 8;
+				nb_bit -= 8;
+			}
+		}
+	}
+}
+
+/* a group of residuals of width W, constant for the shifts and masks to be unrolled */
+template <class U, unsigned int W>
+inline void iqz_unpack_group( const unsigned char* in, U* prev, U* x )
+{
+	const uint64_t mask = ( uint64_t( 1 ) << W ) - 1;
+	for ( unsigned int j = 0; j < IQZ_GROUP_LEN; j += 2 ) {
+		for ( unsigned int c = 0; c < 2; c++ ) {
+			const unsigned int bit = ( j + c ) * W;
+			uint64_t v;
+			std::memcpy( &v, in + bit / 8, sizeof(v) );
+			const U z = ( v >> ( bit % 8 ) ) & mask;
+			prev[ c ] += U( z >> 1 ) ^ U( -( z & 1 ) );
+			x[ j + c ] = prev[ c ];
+		}
+	}
+}
+
+template <class U, unsigned int W>
+struct iqz_unpack_table
+{
+	static void fill( void (**f)( const unsigned char*, U*, U* ) )
+	{
+		f[ W ] = iqz_unpack_group<U, W>;
+		iqz_unpack_table<U, W - 1>::fill( f );
+	}
+};
+
+template <class U>
+struct iqz_unpack_table<U, 0>
+{
+	static void fill( void (**f)( const unsigned char*, U*, U* ) ) { f[ 0 ] = iqz_unpack_group<U, 0>; }
+};
+
+/* the unpacker of every bit width, built once by the thread safe initialization of a static */
+template <class U>
+struct iqz_unpackers
+{
+	iqz_unpackers() { iqz_unpack_table<U, 8 * sizeof(U)>::fill( group ); }
+
+	void (*group[ 8 * sizeof(U) + 1 ])( const unsigned char*, U*, U* );
+};
+
+/*
+  in holds size bytes of payload and is readable 8 bytes past them, x has
+  room for n rounded up to IQZ_GROUP_LEN. False when a width is out of the
+  lane or the groups run past the payload, x being then partly decoded.
+*/
+template <class U>
+bool iqz_unpack( const unsigned char* in, size_t size, unsigned int n, U* x )
+{
+	static const iqz_unpackers<U> unpackers;
+	const unsigned char* const end = in + size;
+	U prev[ 2 ] = { 0, 0 };
+	for ( unsigned int g = 0; g < n; g += IQZ_GROUP_LEN ) {
+		if ( in == end ) {
+			return false;
+		}
+		const unsigned int w = *in++;
+		if ( w > 8 * sizeof(U) || size_t( end - in ) < IQZ_GROUP_LEN * w / 8 ) {
+			return false;
+		}
+		unpackers.group[ w ]( in, prev, x + g );
+		in += IQZ_GROUP_LEN * w / 8;
+	}
+	return true;
+}
+
+class iqz_stream
+{
+public:
+	iqz_stream( FILE* fd, const std::string& path, bool writing, const iqz_format& format, double step, uint32_t block_len )
+		: fd( fd ), path( path ), writing( writing ), format( format ), step( step ), block_len( block_len ),
+		  block( block_len * format.size + IQZ_GROUP_LEN * 8 ), block_size( 0 ), block_pos( 0 ),
+		  block_start( 0 ), next_block( 0 ), raw_len( 0 ), failed( false ), stream( NULL ) {}
+
+	FILE* const fd;
+	const std::string path;
+	const bool writing;
+	const iqz_format format;
+	const double step;
+	const uint32_t block_len;
+
+	std::vector<unsigned char> block;   /* raw bytes of the current block */
+	uint64_t block_size;
+	uint64_t block_pos;
+	uint64_t block_start;               /* raw offset of the current block */
+	uint64_t next_block;
+	std::vector<uint64_t> index;
+	uint64_t raw_len;
+	std::vector<unsigned char> stored;
+	std::vector<uint32_t> q;
+	bool failed;                        /* a corrupted block was met */
+	FILE* stream;                       /* the stream of the tool */
+
+	bool quantized() const { return format.floating && step > 0; }
+
+	void write_block()
+	{
+		if ( block_size == 0 ) {
+			return;
+		}
+		const unsigned int n = block_size / format.size;
+		stored.clear();
+		unsigned char type = IQZ_RAW;
+		if ( ( format.integer || quantized() ) && n * format.size == block_size ) {
+			if ( format.integer ) {
+				if      ( format.size == 1 ) { iqz_pack( (const uint8_t*) &block[0], n, stored ); }
+				else if ( format.size == 2 ) { iqz_pack( (const uint16_t*) &block[0], n, stored ); }
+				else                         { iqz_pack( (const uint32_t*) &block[0], n, stored ); }
+			} else {
+				quantize( n );
+				iqz_pack( &q[0], n, stored );
+			}
+			type = IQZ_PACKED;
+		}
+		if ( type == IQZ_RAW || stored.size() >= block_size ) {
+			stored.assign( block.begin(), block.begin() + block_size );
+			type = IQZ_RAW;
+		}
+		index.push_back( ftello( fd ) );
+		write_record( block_size, stored.size(), type );
+		fwrite( &stored[0], 1, stored.size(), fd );
+		raw_len += block_size;
+		block_start += block_size;
+		block_size = 0;
+	}
+
+	void write_record( uint32_t raw_bytes, uint32_t stored_bytes, unsigned char type )
+	{
+		unsigned char r[ IQZ_RECORD_SIZE ];
+		std::memcpy( r, &raw_bytes, 4 );
+		std::memcpy( r + 4, &stored_bytes, 4 );
+		r[ 8 ] = type;
+		fwrite( r, 1, sizeof(r), fd );
+	}
+
+	void finish()
+	{
+		write_block();
+		write_record( 0, 0, IQZ_RAW );
+		const uint64_t index_offset = ftello( fd );
+		fwrite( &index[0], sizeof(index[0]), index.size(), fd );
+		const uint64_t trailer[ 3 ] = { index_offset, index.size(), raw_len };
+		fwrite( trailer, sizeof(trailer), 1, fd );
+		fwrite( "IQZI", 1, 4, fd );
+	}
+
+	/* decodes the block at the current file position, false at the end or with errno EIO on a corrupted block */
+	bool read_block()
+	{
+		block_start += block_size;
+		block_size = 0;
+		block_pos = 0;
+		unsigned char r[ IQZ_RECORD_SIZE ];
+		if ( fread( r, 1, sizeof(r), fd ) != sizeof(r) ) {
+			return false;
+		}
+		uint32_t raw_bytes, stored_bytes;
+		std::memcpy( &raw_bytes, r, 4 );
+		std::memcpy( &stored_bytes, r + 4, 4 );
+		if ( raw_bytes == 0 ) { /* the end, stay there */
+			fseeko( fd, 0, SEEK_END );
+			return false;
+		}
+		const unsigned int n = raw_bytes / format.size;
+		const bool packable = ( format.integer || quantized() ) && n * format.size == raw_bytes;
+		if ( raw_bytes > block_len * format.size || r[ 8 ] > IQZ_PACKED
+		     || ( r[ 8 ] == IQZ_RAW && stored_bytes != raw_bytes )
+		     || ( r[ 8 ] == IQZ_PACKED && ( !packable || stored_bytes >= raw_bytes ) ) ) {
+			return corrupted();
+		}
+		if ( r[ 8 ] == IQZ_RAW ) {
+			if ( fread( &block[0], 1, raw_bytes, fd ) != raw_bytes ) {
+				return false;
+			}
+		} else {
+			stored.resize( stored_bytes + 8 );
+			if ( fread( &stored[0], 1, stored_bytes, fd ) != stored_bytes ) {
+				return false;
+			}
+			bool unpacked;
+			if ( format.integer ) {
+				if      ( format.size == 1 ) { unpacked = iqz_unpack( &stored[0], stored_bytes, n, (uint8_t*) &block[0] ); }
+				else if ( format.size == 2 ) { unpacked = iqz_unpack( &stored[0], stored_bytes, n, (uint16_t*) &block[0] ); }
+				else                         { unpacked = iqz_unpack( &stored[0], stored_bytes, n, (uint32_t*) &block[0] ); }
+			} else {
+				q.resize( n + IQZ_GROUP_LEN );
+				unpacked = iqz_unpack( &stored[0], stored_bytes, n, &q[0] );
+				if ( unpacked ) {
+					unquantize( n );
+				}
+			}
+			if ( !unpacked ) {
+				return corrupted();
+			}
+		}
+		block_size = raw_bytes;
+		next_block++;
+		return true;
+	}
+
+	bool seek( uint64_t pos )
+	{
+		const uint64_t full = uint64_t( block_len ) * format.size;
+		const uint64_t b = pos / full;
+		if ( index.empty() || pos > raw_len ) {
+			return false;
+		}
+		if ( b != next_block - 1 || block_size == 0 ) {
+			if ( b >= index.size() ) { /* at the very end */
+				fseeko( fd, 0, SEEK_END );
+				block_start = pos;
+				block_size = block_pos = 0;
+				next_block = index.size();
+				return true;
+			}
+			if ( fseeko( fd, index[ b ], SEEK_SET ) != 0 ) {
+				return false;
+			}
+			block_start = b * full;
+			block_size = 0;
+			next_block = b;
+			if ( !read_block() ) {
+				return false;
+			}
+		}
+		block_pos = pos - block_start;
+		return true;
+	}
+
+private:
+	/* nothing more is read past a corrupted block */
+	bool corrupted()
+	{
+		if ( !failed ) {
+			std::cerr << path << " : corrupted block " << next_block << "\n";
+		}
+		failed = true;
+		fseeko( fd, 0, SEEK_END );
+		errno = EIO;
+		return false;
+	}
+
+	void quantize( unsigned int n )
+	{
+		q.resize( n + IQZ_GROUP_LEN );
+		for ( unsigned int i = 0; i < n; i++ ) {
+			double x = sample( i ) / step;
+			x = ( x >= -2147483648. ) ? x : -2147483648.;
+			x = ( x <= 2147483647. ) ? x : 2147483647.;
+			q[ i ] = uint32_t( int32_t( std::floor( x + 0.5 ) ) );
+		}
+	}
+
+	void unquantize( unsigned int n )
+	{
+		for ( unsigned int i = 0; i < n; i++ ) {
+			const double x = int32_t( q[ i ] ) * step;
+			if      ( format.size == 2 ) { f16_sample v( x ); std::memcpy( &block[ 2*i ], &v, 2 ); }
+			else if ( format.size == 4 ) { float v = x; std::memcpy( &block[ 4*i ], &v, 4 ); }
+			else                         { std::memcpy( &block[ 8*i ], &x, 8 ); }
+		}
+	}
+
+	double sample( unsigned int i ) const
+	{
+		if ( format.size == 2 ) { f16_sample v; std::memcpy( (void*) &v, &block[ 2*i ], 2 ); return v; }
+		if ( format.size == 4 ) { float v; std::memcpy( &v, &block[ 4*i ], 4 ); return v; }
+		double v;
+		std::memcpy( &v, &block[ 8*i ], 8 );
+		return v;
+	}
+};
+
+inline ssize_t iqz_write( void* cookie, const char* buf, size_t size )
+{
+	iqz_stream* s = (iqz_stream*) cookie;
+	const uint64_t full = uint64_t( s->block_len ) * s->format.size;
+	size_t done = 0;
+	while ( done < size ) {
+		const size_t len = std::min<uint64_t>( size - done, full - s->block_size );
+		std::memcpy( &s->block[ s->block_size ], buf + done, len );
+		s->block_size += len;
+		done += len;
+		if ( s->block_size == full ) {
+			s->write_block();
+		}
+	}
+	return size;
+}
+
+inline ssize_t iqz_read( void* cookie, char* buf, size_t size )
+{
+	iqz_stream* s = (iqz_stream*) cookie;
+	size_t done = 0;
+	while ( done < size ) {
+		if ( s->block_pos == s->block_size && !s->read_block() ) {
+			if ( done == 0 && s->failed ) {
+				errno = EIO;
+				return -1;
+			}
+			break;
+		}
+		const size_t len = std::min<uint64_t>( size - done, s->block_size - s->block_pos );
+		std::memcpy( buf + done, &s->block[ s->block_pos ], len );
+		s->block_pos += len;
+		done += len;
+	}
+	return done;
+}
+
+inline int iqz_seek( void* cookie, off64_t* offset, int whence )
+{
+	iqz_stream* s = (iqz_stream*) cookie;
+	if ( s->writing ) { /* only ftell */
+		if ( whence != SEEK_CUR || *offset != 0 ) {
+			errno = ESPIPE;
+			return -1;
+		}
+		*offset = s->raw_len + s->block_size;
+		return 0;
+	}
+	int64_t pos = *offset;
+	if      ( whence == SEEK_CUR ) { pos += s->block_start + s->block_pos; }
+	else if ( whence == SEEK_END ) { pos += s->raw_len; }
+	if ( pos < 0 || !s->seek( pos ) ) {
+		errno = ( s->index.empty() ) ? ESPIPE : EINVAL;
+		return -1;
+	}
+	*offset = pos;
+	return 0;
+}
+
+std::vector<FILE*>& iqz_open_streams();
+
+/* guards iqz_open_streams(), the pipeline opening and closing its captures from several threads */
+inline std::mutex& iqz_open_streams_mutex()
+{
+	static std::mutex m;
+	return m;
+}
+
+inline int iqz_close( void* cookie )
+{
+	iqz_stream* s = (iqz_stream*) cookie;
+	if ( s->writing ) {
+		s->finish();
+	}
+	{
+		std::lock_guard<std::mutex> lock( iqz_open_streams_mutex() );
+		std::vector<FILE*>& streams = iqz_open_streams();
+		streams.erase( std::remove( streams.begin(), streams.end(), s->stream ), streams.end() );
+	}
+	const int r = fclose( s->fd );
+	delete s;
+	return r;
+}
+
+/* the tools leave their streams to exit(), which flushes them without closing them */
+inline void iqz_close_all()
+{
+	io_close_all();
+	std::vector<FILE*> streams;
+	{
+		std::lock_guard<std::mutex> lock( iqz_open_streams_mutex() );
+		streams = iqz_open_streams();
+	}
+	for ( unsigned int i = 0; i < streams.size(); i++ ) {
+		fclose( streams[ i ] );
+	}
+}
+
+/* with iqz_open_streams_mutex() held, which covers the registration of iqz_close_all() too */
+inline std::vector<FILE*>& iqz_open_streams()
+{
+	static std::vector<FILE*> streams;
+	static bool registered = false;
+	if ( !registered ) {
+		registered = true;
+		atexit( iqz_close_all );
+	}
+	return streams;
+}
+
+/*
+  Opens a capture file like fopen(), as a compressed container when its
+  name ends with .iqz (followed by the ":STEP" of the writer, if any).
+  data_format is the format of the samples read or written, a container
+  holding an other one being refused.
+*/
+inline FILE* capture_open( const char* capture_file, const char* mode, const std::string& data_format )
+{
+	std::string path = capture_file;
+	double step = 0;
+	const size_t ext = path.rfind( ".iqz" );
+	if ( ext == std::string::npos || ( ext + 4 != path.size() && path[ ext + 4 ] != ':' ) ) {
+		return fopen( capture_file, mode );
+	}
+	if ( ext + 4 != path.size() ) {
+		step = atof( path.c_str() + ext + 5 );
+		path.resize( ext + 4 );
+	}
+	int f = 0;
+	while ( f < IQZ_NB_FORMAT && data_format != IQZ_FORMATS[ f ].name ) {
+		f++;
+	}
+	if ( f == IQZ_NB_FORMAT ) {
+		errno = EINVAL;
+		return NULL;
+	}
+	const bool writing = ( mode[0] == 'w' );
+	FILE* fd = fopen( path.c_str(), writing ? "wb" : "rb" );
+	if ( fd == NULL ) {
+		return NULL;
+	}
+	unsigned char h[ IQZ_HEADER_SIZE ] = { 'I', 'Q', 'Z', '1' };
+	uint32_t block_len = IQZ_BLOCK_LEN;
+	if ( writing ) {
+		h[ 4 ] = f;
+		h[ 5 ] = IQZ_FORMATS[ f ].size;
+		std::memcpy( h + 8, &block_len, 4 );
+		std::memcpy( h + 16, &step, 8 );
+		fwrite( h, 1, sizeof(h), fd );
+	} else {
+		if ( fread( h, 1, sizeof(h), fd ) != sizeof(h) || std::memcmp( h, "IQZ1", 4 ) != 0 || h[ 4 ] >= IQZ_NB_FORMAT ) {
+			std::cerr << path << " : not a compressed capture file\n";
+			fclose( fd );
+			errno = EINVAL;
+			return NULL;
+		}
+		if ( h[ 4 ] != f ) {
+			std::cerr << path << " : the capture file holds " << IQZ_FORMATS[ h[ 4 ] ].name << " samples, not " << data_format << "\n";
+			fclose( fd );
+			errno = EINVAL;
+			return NULL;
+		}
+		std::memcpy( &block_len, h + 8, 4 );
+		std::memcpy( &step, h + 16, 8 );
+		if ( block_len == 0 || block_len > IQZ_BLOCK_LEN || h[ 5 ] != IQZ_FORMATS[ f ].size ) {
+			std::cerr << path << " : corrupted header\n";
+			fclose( fd );
+			errno = EINVAL;
+			return NULL;
+		}
+	}
+	iqz_stream* s = new iqz_stream( fd, path, writing, IQZ_FORMATS[ f ], step, block_len );
+	if ( !writing ) { /* the index, when the file is complete and seekable */
+		unsigned char t[ IQZ_TRAILER_SIZE ];
+		uint64_t trailer[ 3 ];
+		const off_t index_end = ( fseeko( fd, -(off_t) IQZ_TRAILER_SIZE, SEEK_END ) == 0 ) ? ftello( fd ) : 0;
+		if ( index_end > 0 && fread( t, 1, sizeof(t), fd ) == sizeof(t) && std::memcmp( t + 24, "IQZI", 4 ) == 0 ) {
+			std::memcpy( trailer, t, sizeof(trailer) );
+			/* the index fills the place between its offset and the trailer, or is ignored */
+			const bool fits = trailer[ 0 ] <= uint64_t( index_end ) && trailer[ 1 ] == ( index_end - trailer[ 0 ] ) / sizeof(uint64_t)
+			                  && ( index_end - trailer[ 0 ] ) % sizeof(uint64_t) == 0;
+			s->index.resize( fits ? trailer[ 1 ] : 0 );
+			s->raw_len = trailer[ 2 ];
+			if ( fseeko( fd, trailer[ 0 ], SEEK_SET ) != 0 || fread( &s->index[0], sizeof(uint64_t), s->index.size(), fd ) != s->index.size() ) {
+				s->index.clear();
+			}
+		}
+		fseeko( fd, IQZ_HEADER_SIZE, SEEK_SET );
+	}
+	cookie_io_functions_t io = { iqz_read, iqz_write, iqz_seek, iqz_close };
+	FILE* stream = fopencookie( s, writing ? "w" : "r", io );
+	if ( stream == NULL ) {
+		fclose( fd );
+		delete s;
+		return NULL;
+	}
+	s->stream = stream;
+	std::lock_guard<std::mutex> lock( iqz_open_streams_mutex() );
+	iqz_open_streams().push_back( stream );
+	return stream;
+}
+
+#endif
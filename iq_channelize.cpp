@@ -0,0 +1,277 @@
+/*
+  ===========================================================================
+
+  Copyright (C) 2018 Emvivre
+
+  This file is part of IQ_CHANNELIZE.
+
+  IQ_CHANNELIZE is free software: you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation, either version 3 of the License, or
+  (at your option) any later version.
+
+  IQ_CHANNELIZE is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with IQ_CHANNELIZE.  If not, see <http://www.gnu.org/licenses/>.
+
+  ===========================================================================
+*/
+
+#include <iostream>
+#include <complex>
+#include <vector>
+#include <algorithm>
+#include "iq_u8.h"
+#include "iq_f16.h"
+#include "iq_capture.h"
+#include "iq_io.h"
+#include "fir.h"
+#include "iq_fft.h"
+
+static const unsigned int NB_COEF_PER_BRANCH = 16;
+static const unsigned int MAX_NB_CHANNEL = 65536;
+
+/*
+  Critically sampled polyphase analysis filter bank: channel k is the input
+  shifted down by k * sample_rate / nb_channel, low-pass filtered by the
+  prototype and decimated by nb_channel. Writing the prototype index as
+  p * nb_channel + r, the filter is split into nb_channel branches of
+  nb_coef_per_branch coefficients, and the nb_channel outputs of one
+  decimated instant are the inverse FFT of the branch outputs. The cost per
+  input sample is nb_coef_per_branch multiply-accumulates plus
+  log2(nb_channel) butterflies, whatever the number of channels extracted.
+*/
+class pfb_channelizer
+{
+public:
+	pfb_channelizer( unsigned int nb_channel, unsigned int nb_coef_per_branch, const std::vector<double>& coef )
+		: nb_channel( nb_channel ), nb_coef_per_branch( nb_coef_per_branch ),
+		  pos( nb_channel * nb_coef_per_branch - 1 ), hist( nb_channel * nb_coef_per_branch - 1 ),
+		  branch_coef( nb_channel * nb_coef_per_branch ), engine( nb_channel ), seg( nb_channel )
+	{
+		for ( unsigned int r = 0; r < nb_channel; r++ ) {
+			for ( unsigned int p = 0; p < nb_coef_per_branch; p++ ) {
+				branch_coef[ r * nb_coef_per_branch + p ] = coef[ p * nb_channel + r ];
+			}
+		}
+	}
+
+	/*
+	  out[ m * nb_channel + k ] is the m-th decimated sample of channel k
+	  (the channel -k being at nb_channel - k), out needs room for
+	  ( n / nb_channel + 1 ) * nb_channel samples. Returns the number of
+	  decimated instants written.
+	*/
+	unsigned int process( const std::complex<double>* in, unsigned int n, std::complex<double>* out )
+	{
+		buff.resize( hist.size() + n );
+		std::copy( hist.begin(), hist.end(), buff.begin() );
+		std::copy( in, in + n, buff.begin() + hist.size() );
+		unsigned int m = 0;
+		while ( pos < buff.size() ) {
+			for ( unsigned int r = 0; r < nb_channel; r++ ) {
+				const std::complex<double>* x = &buff[ pos - r ];
+				const double* c = &branch_coef[ r * nb_coef_per_branch ];
+				double re = 0, im = 0;
+				for ( unsigned int p = 0; p < nb_coef_per_branch; p++ ) {
+					re += c[ p ] * x[ - (long) ( p * nb_channel ) ].real();
+					im += c[ p ] * x[ - (long) ( p * nb_channel ) ].imag();
+				}
+				seg[ r ] = std::complex<double>( re, im );
+			}
+			engine.transform( &seg[0], true );
+			std::copy( seg.begin(), seg.end(), out + m * nb_channel );
+			m++;
+			pos += nb_channel;
+		}
+		pos -= n;
+		std::copy( buff.end() - hist.size(), buff.end(), hist.begin() );
+		return m;
+	}
+
+private:
+	unsigned int nb_channel;
+	unsigned int nb_coef_per_branch;
+	unsigned int pos;
+	std::vector< std::complex<double> > hist;
+	std::vector< std::complex<double> > buff;
+	std::vector<double> branch_coef;
+	fft engine;
+	std::vector< std::complex<double> > seg;
+};
+
+struct channel_output
+{
+	int channel;
+	const char* capture_file;
+	FILE* fd;
+};
+
+template <class T>
+void channelize( const unsigned int sample_rate, const unsigned int nb_channel, const unsigned int nb_coef_per_branch, const unsigned int block_size, const std::vector<channel_output>& outputs, FILE* fd_input )
+{
+	const unsigned int nb_coef = nb_channel * nb_coef_per_branch;
+	std::vector<double> coef( nb_coef );
+	fir_gen( BLACKMAN_WINDOW_TYPE, nb_coef, sample_rate, 0.5 * sample_rate / nb_channel, &coef[0], NULL, NULL );
+	double sum = 0;
+	for ( unsigned int i = 0; i < nb_coef; i++ ) {
+		sum += coef[ i ];
+	}
+	for ( unsigned int i = 0; i < nb_coef; i++ ) {
+		coef[ i ] /= sum;
+	}
+	pfb_channelizer channelizer( nb_channel, nb_coef_per_branch, coef );
+	const unsigned int out_len = block_size / nb_channel + 1;
+	T* in_buff = new T[ 2*block_size ];
+	T* out_buff = new T[ 2*out_len ];
+	std::complex<double>* x = new std::complex<double>[ block_size ];
+	std::complex<double>* y = new std::complex<double>[ out_len * nb_channel ];
+	size_t n;
+	while( ( n = io_read( in_buff, 2*sizeof(*in_buff), block_size, fd_input) ) > 0 ) {
+		for ( unsigned int i = 0; i < n; i++ ) {
+			x[ i ] = std::complex<double>( in_buff[ 2*i ], in_buff[ 2*i+1 ] );
+		}
+		const unsigned int nb_output = channelizer.process( x, n, y );
+		for ( unsigned int c = 0; c < outputs.size(); c++ ) {
+			const unsigned int k = ( outputs[ c ].channel + nb_channel ) % nb_channel;
+			for ( unsigned int m = 0; m < nb_output; m++ ) {
+				out_buff[ 2*m ] = y[ m * nb_channel + k ].real();
+				out_buff[ 2*m+1 ] = y[ m * nb_channel + k ].imag();
+			}
+			io_write( out_buff, 2*sizeof(*out_buff), nb_output, outputs[ c ].fd );
+			io_flush( outputs[ c ].fd );
+		}
+	}
+	delete[] y;
+	delete[] x;
+	delete[] out_buff;
+	delete[] in_buff;
+}
+
+int main(int argc, char** argv)
+{
+	if ( argc < 2 ) {
+		std::cerr << "Usage: " << argv[0] << " <OPTIONS>\n"
+			"  -s <SAMPLE_RATE>\n"
+			"  -M <NB_CHANNEL> : power of two, the output sample rate is SAMPLE_RATE / NB_CHANNEL\n"
+			"  -c <CHANNEL>:<OUTPUT_CAPTURE_FILE> : channel centered on CHANNEL * SAMPLE_RATE / NB_CHANNEL,\n"
+			"     CHANNEL in [ -NB_CHANNEL/2, NB_CHANNEL/2 [, can be repeated (- for stdout)\n"
+			"  -n <NB_COEF_PER_BRANCH> (default: 16)\n"
+			"  -d <DATA_FORMAT> : i8 | u8 | i16 | i32 | f16 | f32 | f64 (default: i16)\n"
+			"  -b <BLOCK_SIZE> : samples per block, lower for less latency (default: SAMPLE_RATE)\n"
+			"  -i <INPUT_CAPTURE_FILE> (default: -)\n"
+			"  --stats-interval <SECONDS> : print the I/O and compute counters every SECONDS on stderr (default: on SIGUSR1 only)\n"
+			"  --stats-file <STATS_FILE> : rewrite the counters in STATS_FILE, every second by default\n";
+		return 1;
+	}
+	io_stats_start( argc, argv );
+	const std::string prog_name = argv[0];
+	unsigned int sample_rate = 0;
+	int nb_channel = 0;
+	int nb_coef_per_branch = NB_COEF_PER_BRANCH;
+	int block_size = 0;
+	std::string data_format = "i16";
+	std::vector<channel_output> outputs;
+	const char* input_capture_file = "-";
+	for ( int i = 1; i < argc; i += 2 ) {
+		std::string arg = argv[i];
+		if ( arg == "-s" ) {
+			sample_rate = atof( argv[i+1] );
+		} else if ( arg == "-M" ) {
+			nb_channel = atoi( argv[i+1] );
+		} else if ( arg == "-c" ) {
+			channel_output o;
+			char* sep;
+			o.channel = strtol( argv[i+1], &sep, 10 );
+			if ( sep == argv[i+1] || *sep != ':' || sep[1] == '\0' ) {
+				std::cerr << prog_name << " : ERROR: please set channels as <CHANNEL>:<OUTPUT_CAPTURE_FILE> !\n";
+				return 1;
+			}
+			o.capture_file = sep + 1;
+			o.fd = NULL;
+			outputs.push_back( o );
+		} else if ( arg == "-n" ) {
+			nb_coef_per_branch = atoi( argv[i+1] );
+		} else if ( arg == "-b" ) {
+			block_size = atoi( argv[i+1] );
+		} else if ( arg == "-d" ) {
+			data_format = argv[i+1];
+		} else if ( arg == "-i" ) {
+			input_capture_file = argv[i+1];
+		}
+	}
+	if ( sample_rate == 0 ) {
+		std::cerr << prog_name << " : ERROR: please set a valid sample rate !\n";
+		return 1;
+	}
+	if ( nb_channel < 2 || nb_channel > (int) MAX_NB_CHANNEL || ( nb_channel & ( nb_channel - 1 ) ) != 0 ) {
+		std::cerr << prog_name << " : ERROR: please set a valid number of channels !\n";
+		return 1;
+	}
+	if ( outputs.empty() ) {
+		std::cerr << prog_name << " : ERROR: please set at least one channel !\n";
+		return 1;
+	}
+	for ( unsigned int c = 0; c < outputs.size(); c++ ) {
+		if ( outputs[ c ].channel < - nb_channel / 2 || outputs[ c ].channel >= nb_channel / 2 ) {
+			std::cerr << prog_name << " : ERROR: please set a valid channel !\n";
+			return 1;
+		}
+	}
+	if ( nb_coef_per_branch <= 0 ) {
+		std::cerr << prog_name << " : ERROR: please set a valid number of coefficients !\n";
+		return 1;
+	}
+	if ( data_format == "cu8" ) {
+		data_format = "u8";
+	}
+	if ( data_format != "i8" &&
+	     data_format != "u8" &&
+	     data_format != "i16" &&
+	     data_format != "i32" &&
+	     data_format != "f16" &&
+	     data_format != "f32" &&
+	     data_format != "f64" ) {
+		std::cerr << prog_name << " : ERROR: please set a valid data format !\n";
+		return 1;
+	}
+	if ( block_size < 0 ) {
+		std::cerr << prog_name << " : ERROR: please set a valid block size !\n";
+		return 1;
+	}
+	if ( block_size == 0 ) {
+		block_size = sample_rate;
+	}
+	FILE* fd_input = stdin;
+	if ( input_capture_file != std::string("-") ) {
+		fd_input = capture_open( input_capture_file, "rb", data_format );
+		if ( fd_input == NULL ) {
+			std::cerr << prog_name << " : ";
+			perror("fopen()");
+			return 1;
+		}
+	}
+	for ( unsigned int c = 0; c < outputs.size(); c++ ) {
+		outputs[ c ].fd = stdout;
+		if ( outputs[ c ].capture_file != std::string("-") ) {
+			outputs[ c ].fd = capture_open( outputs[ c ].capture_file, "w+b", data_format );
+			if ( outputs[ c ].fd == NULL ) {
+				std::cerr << prog_name << " : ";
+				perror("fopen()");
+				return 1;
+			}
+		}
+	}
+	if      ( data_format == "i8"  ) { channelize<char>( sample_rate, nb_channel, nb_coef_per_branch, block_size, outputs, fd_input); }
+	else if ( data_format == "u8"  ) { channelize<u8_sample>( sample_rate, nb_channel, nb_coef_per_branch, block_size, outputs, fd_input); }
+	else if ( data_format == "i16" ) { channelize<short>( sample_rate, nb_channel, nb_coef_per_branch, block_size, outputs, fd_input); }
+	else if ( data_format == "i32" ) { channelize<int>( sample_rate, nb_channel, nb_coef_per_branch, block_size, outputs, fd_input); }
+	else if ( data_format == "f16" ) { channelize<f16_sample>( sample_rate, nb_channel, nb_coef_per_branch, block_size, outputs, fd_input); }
+	else if ( data_format == "f32" ) { channelize<float>( sample_rate, nb_channel, nb_coef_per_branch, block_size, outputs, fd_input); }
+	else if ( data_format == "f64" ) { channelize<double>( sample_rate, nb_channel, nb_coef_per_branch, block_size, outputs, fd_input); }
+	return 0;
+}
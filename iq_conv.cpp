@@ -22,34 +22,276 @@
 */
 
 #include <iostream>
+#include <cstring>
+#include <limits>
+#include <type_traits>
+#include <algorithm>
+#include <stdint.h>
+#include "iq_u8.h"
+#include "iq_f16.h"
+#include "iq_capture.h"
+#include "iq_io.h"
 
 static const unsigned int BUFFER_LEN = 200000;
+#if defined(__AVX__)
+static const int CONV_WIDTH = 32;
+#else
+static const int CONV_WIDTH = 16; /* without AVX, the selects of wider vectors are split into scalar code */
+#endif
+static const int CONV_MAX_LANE = CONV_WIDTH / sizeof(float); /* BUFFER_LEN is a multiple of it */
+
+/*
+  Storage of a sample format: the type of the stored lanes, the offset
+  added to the value when it is stored and the value standing for 1.0 in
+  the full scale mode. The formats exact in float do not need a double
+  intermediate when converted to one another.
+*/
+template <class T>
+struct sample_format
+{
+	typedef T raw;
+	static const bool integer = std::numeric_limits<T>::is_integer;
+	static const bool exact_in_float = ( integer && sizeof(T) <= 2 ) || std::is_same<T, float>::value;
+	static double bias() { return 0; }
+	static double full_scale() { return integer ? -double( std::numeric_limits<T>::min() ) : 1; }
+};
+
+template <>
+struct sample_format<u8_sample>
+{
+	typedef unsigned char raw;
+	static const bool integer = true;
+	static const bool exact_in_float = true;
+	static double bias() { return 128; }
+	static double full_scale() { return 128; }
+};
+
+/*
+  Converts whole vectors of CONV_WIDTH bytes of intermediate: the input lanes are
+  widened to the intermediate type, unbiased and scaled. Integer outputs
+  are then saturated to the output range, rounded half away from zero and
+  narrowed. n is rounded up to a multiple of CONV_MAX_LANE.
+*/
+template <class Input, class Output>
+void conv_block( const Input* in, unsigned int n, const double scale, Output* out )
+{
+	typedef sample_format<Input> in_format;
+	typedef sample_format<Output> out_format;
+	typedef typename std::conditional< in_format::exact_in_float && out_format::exact_in_float, float, double >::type C;
+	typedef typename in_format::raw in_lane;
+	typedef typename out_format::raw out_lane;
+	static const int NB_LANE = CONV_WIDTH / sizeof(C);
+	typedef in_lane in_vec __attribute__(( vector_size( NB_LANE * sizeof(in_lane) ) ));
+	typedef out_lane out_vec __attribute__(( vector_size( NB_LANE * sizeof(out_lane) ) ));
+	typedef C c_vec __attribute__(( vector_size( NB_LANE * sizeof(C) ) ));
+	typedef int i_vec __attribute__(( vector_size( NB_LANE * sizeof(int) ) ));
+
+	const c_vec zero = c_vec();
+	const c_vec lo = zero - C( out_format::full_scale() );
+	const c_vec hi = zero + C( out_format::full_scale() - 1 );
+	const c_vec half = zero + C( 0.5 );
+	const i_vec bias = i_vec() + int( out_format::bias() );
+	for ( unsigned int i = 0; i < n; i += NB_LANE ) {
+		in_vec a;
+		std::memcpy( &a, in + i, sizeof(a) );
+		c_vec v = ( __builtin_convertvector( a, c_vec ) - C( in_format::bias() ) ) * C( scale );
+		out_vec o;
+		if ( out_format::integer ) {
+			v = ( v >= lo ) ? v : lo; /* NaN maps to the lowest value */
+			v = ( v <= hi ) ? v : hi;
+			/* the fraction left by the truncation is exact, adding 0.5 would round it */
+			const i_vec t = __builtin_convertvector( v, i_vec );
+			const c_vec f = v - __builtin_convertvector( t, c_vec );
+			const i_vec k = t - __builtin_convertvector( f >= half, i_vec ) + __builtin_convertvector( f <= -half, i_vec );
+			o = __builtin_convertvector( k + bias, out_vec );
+		} else {
+			o = __builtin_convertvector( v, out_vec );
+		}
+		std::memcpy( (void*) ( out + i ), &o, sizeof(o) );
+	}
+}
 
 template <class Input, class Output>
-void conv_( FILE* fd_input, FILE* fd_output )
+void conv_( const bool full_scale, FILE* fd_input, FILE* fd_output )
 {
+	const double scale = full_scale ? sample_format<Output>::full_scale() / sample_format<Input>::full_scale() : 1;
 	Input* in_buff = new Input[ BUFFER_LEN ];
 	Output* out_buff = new Output[ BUFFER_LEN ];
+	io_reserve( fd_output, io_remaining( fd_input ) / sizeof(Input) * sizeof(Output) );
+	const Input* in;
 	unsigned int nb_sample_read;
-	while( (nb_sample_read = fread( in_buff, sizeof(*in_buff), BUFFER_LEN, fd_input)) > 0 ) {
-		for ( unsigned int i = 0; i < nb_sample_read; i++ ) {
-			out_buff[ i ] = in_buff[ i ];
+	while( (nb_sample_read = io_view( &in, in_buff, sizeof(*in_buff), BUFFER_LEN, fd_input)) > 0 ) {
+		const unsigned int nb_lane = ( nb_sample_read + CONV_MAX_LANE - 1 ) / CONV_MAX_LANE * CONV_MAX_LANE;
+		Output* out = out_buff;
+		if ( nb_lane == nb_sample_read ) {
+			out = io_room( out_buff, sizeof(*out_buff), nb_sample_read, fd_output );
+		} else { /* the last block is padded in the buffers */
+			std::memmove( (void*) in_buff, in, nb_sample_read * sizeof(*in_buff) );
+			std::memset( (void*) ( in_buff + nb_sample_read ), 0, ( nb_lane - nb_sample_read ) * sizeof(*in_buff) );
+			in = in_buff;
 		}
-		fwrite( out_buff, sizeof(*out_buff), nb_sample_read, fd_output );
-		fflush( fd_output );
+		conv_block( in, nb_lane, scale, out );
+		io_commit( out, sizeof(*out_buff), nb_sample_read, fd_output );
+		io_flush( fd_output );
 	}
         delete[] out_buff;
 	delete[] in_buff;
 }
 
+/*
+  Formats whose samples are not an arithmetic lane, converted in blocks
+  to and from float:
+    f16  : IEEE half precision, with the F16C instructions when available
+    sc12 : packed 12 bit I/Q, each pair in 3 bytes, the little endian
+           24 bit word I | Q << 12 of two's complement values
+*/
+class packed_format
+{
+public:
+	explicit packed_format( const std::string& name ) : sc12( name == "sc12" ) {}
+
+	/* samples and bytes of the smallest whole unit */
+	unsigned int unit_len() const { return sc12 ? 2 : 1; }
+	unsigned int unit_size() const { return sc12 ? 3 : 2; }
+	double full_scale() const { return sc12 ? 2048 : 1; }
+
+	void decode( const unsigned char* in, unsigned int n, float* out ) const
+	{
+		if ( !sc12 ) {
+			f16_decode( (const f16_sample*) in, n, out );
+			return;
+		}
+		for ( unsigned int k = 0; k < n / 2; k++ ) {
+			const uint32_t w = in[ 3*k ] | ( in[ 3*k+1 ] << 8 ) | ( in[ 3*k+2 ] << 16 );
+			out[ 2*k ] = int32_t( w << 20 ) >> 20;
+			out[ 2*k+1 ] = int32_t( w << 8 ) >> 20;
+		}
+	}
+
+	void encode( const float* in, unsigned int n, unsigned char* out ) const
+	{
+		if ( !sc12 ) {
+			f16_encode( in, n, (f16_sample*) out );
+			return;
+		}
+		for ( unsigned int k = 0; k < n / 2; k++ ) {
+			const uint32_t w = ( to_sc12( in[ 2*k ] ) & 0xfff ) | ( to_sc12( in[ 2*k+1 ] ) << 12 );
+			out[ 3*k ] = w;
+			out[ 3*k+1 ] = w >> 8;
+			out[ 3*k+2 ] = w >> 16;
+		}
+	}
+
+private:
+	/* saturated to [ -2048, 2047 ] and rounded half away from zero, NaN mapping to -2048 */
+	static int to_sc12( float v )
+	{
+		v = ( v >= -2048 ) ? v : -2048;
+		v = ( v <= 2047 ) ? v : 2047;
+		const int t = int( v );
+		const float f = v - t;
+		return t + ( f >= 0.5f ) - ( f <= -0.5f );
+	}
+
+	const bool sc12;
+};
+
+inline unsigned int round_lane( unsigned int n )
+{
+	return ( n + CONV_MAX_LANE - 1 ) / CONV_MAX_LANE * CONV_MAX_LANE;
+}
+
+template <class Input>
+void conv_to_packed( const packed_format& format, const bool full_scale, FILE* fd_input, FILE* fd_output )
+{
+	const double scale = full_scale ? format.full_scale() / sample_format<Input>::full_scale() : 1;
+	const unsigned int nb_unit = BUFFER_LEN / format.unit_len();
+	Input* in_buff = new Input[ BUFFER_LEN ];
+	float* float_buff = new float[ BUFFER_LEN ];
+	unsigned char* out_buff = new unsigned char[ nb_unit * format.unit_size() ];
+	unsigned int nb_unit_read;
+	while( (nb_unit_read = io_read( in_buff, format.unit_len() * sizeof(*in_buff), nb_unit, fd_input)) > 0 ) {
+		const unsigned int n = nb_unit_read * format.unit_len();
+		std::memset( (void*) ( in_buff + n ), 0, ( round_lane( n ) - n ) * sizeof(*in_buff) );
+		conv_block( in_buff, round_lane( n ), scale, float_buff );
+		format.encode( float_buff, n, out_buff );
+		io_write( out_buff, format.unit_size(), nb_unit_read, fd_output );
+		io_flush( fd_output );
+	}
+	delete[] out_buff;
+	delete[] float_buff;
+	delete[] in_buff;
+}
+
+template <class Output>
+void conv_from_packed( const packed_format& format, const bool full_scale, FILE* fd_input, FILE* fd_output )
+{
+	const double scale = full_scale ? sample_format<Output>::full_scale() / format.full_scale() : 1;
+	const unsigned int nb_unit = BUFFER_LEN / format.unit_len();
+	unsigned char* in_buff = new unsigned char[ nb_unit * format.unit_size() ];
+	float* float_buff = new float[ BUFFER_LEN ];
+	Output* out_buff = new Output[ BUFFER_LEN ];
+	unsigned int nb_unit_read;
+	while( (nb_unit_read = io_read( in_buff, format.unit_size(), nb_unit, fd_input)) > 0 ) {
+		const unsigned int n = nb_unit_read * format.unit_len();
+		format.decode( in_buff, n, float_buff );
+		std::fill( float_buff + n, float_buff + round_lane( n ), 0.f );
+		conv_block( float_buff, round_lane( n ), scale, out_buff );
+		io_write( out_buff, sizeof(*out_buff), n, fd_output );
+		io_flush( fd_output );
+	}
+	delete[] out_buff;
+	delete[] float_buff;
+	delete[] in_buff;
+}
+
+void conv_packed( const packed_format& input_format, const packed_format& output_format, const bool full_scale, FILE* fd_input, FILE* fd_output )
+{
+	const float scale = full_scale ? output_format.full_scale() / input_format.full_scale() : 1;
+	const unsigned int unit_len = std::max( input_format.unit_len(), output_format.unit_len() );
+	const unsigned int nb_unit = BUFFER_LEN / unit_len;
+	const unsigned int in_unit_size = unit_len / input_format.unit_len() * input_format.unit_size();
+	const unsigned int out_unit_size = unit_len / output_format.unit_len() * output_format.unit_size();
+	unsigned char* in_buff = new unsigned char[ nb_unit * in_unit_size ];
+	float* float_buff = new float[ BUFFER_LEN ];
+	unsigned char* out_buff = new unsigned char[ nb_unit * out_unit_size ];
+	unsigned int nb_unit_read;
+	while( (nb_unit_read = io_read( in_buff, in_unit_size, nb_unit, fd_input)) > 0 ) {
+		const unsigned int n = nb_unit_read * unit_len;
+		input_format.decode( in_buff, n, float_buff );
+		for ( unsigned int i = 0; i < n; i++ ) {
+			float_buff[ i ] *= scale;
+		}
+		output_format.encode( float_buff, n, out_buff );
+		io_write( out_buff, out_unit_size, nb_unit_read, fd_output );
+		io_flush( fd_output );
+	}
+	delete[] out_buff;
+	delete[] float_buff;
+	delete[] in_buff;
+}
+
+void conv_packed( const packed_format& input_format, const std::string& output_data_format, const bool full_scale, FILE* fd_input, FILE* fd_output )
+{
+	if      ( output_data_format == "i8"  ) { conv_from_packed<char>( input_format, full_scale, fd_input, fd_output); }
+	else if ( output_data_format == "u8"  ) { conv_from_packed<u8_sample>( input_format, full_scale, fd_input, fd_output); }
+	else if ( output_data_format == "i16" ) { conv_from_packed<short>( input_format, full_scale, fd_input, fd_output); }
+	else if ( output_data_format == "i32" ) { conv_from_packed<int>( input_format, full_scale, fd_input, fd_output); }
+	else if ( output_data_format == "f32" ) { conv_from_packed<float>( input_format, full_scale, fd_input, fd_output); }
+	else if ( output_data_format == "f64" ) { conv_from_packed<double>( input_format, full_scale, fd_input, fd_output); }
+	else { conv_packed( input_format, packed_format( output_data_format ), full_scale, fd_input, fd_output ); }
+}
+
 template <class T>
-void conv( const std::string& output_data_format, FILE* fd_input, FILE* fd_output )
+void conv( const std::string& output_data_format, const bool full_scale, FILE* fd_input, FILE* fd_output )
 {
-	if      ( output_data_format == "i8"  ) { conv_<T,char>( fd_input, fd_output); }
-	else if ( output_data_format == "i16" ) { conv_<T,short>(fd_input, fd_output); }
-	else if ( output_data_format == "i32" ) { conv_<T,int>( fd_input, fd_output); }
-	else if ( output_data_format == "f32" ) { conv_<T,float>( fd_input, fd_output); }
-	else if ( output_data_format == "f64" ) { conv_<T,double>( fd_input, fd_output); }
+	if      ( output_data_format == "i8"  ) { conv_<T,char>( full_scale, fd_input, fd_output); }
+	else if ( output_data_format == "u8"  ) { conv_<T,u8_sample>( full_scale, fd_input, fd_output); }
+	else if ( output_data_format == "i16" ) { conv_<T,short>( full_scale, fd_input, fd_output); }
+	else if ( output_data_format == "i32" ) { conv_<T,int>( full_scale, fd_input, fd_output); }
+	else if ( output_data_format == "f32" ) { conv_<T,float>( full_scale, fd_input, fd_output); }
+	else if ( output_data_format == "f64" ) { conv_<T,double>( full_scale, fd_input, fd_output); }
+	else { conv_to_packed<T>( packed_format( output_data_format ), full_scale, fd_input, fd_output); }
 }
 
 int main(int argc, char** argv)
@@ -57,15 +299,20 @@ int main(int argc, char** argv)
 	if ( argc < 2 ) {
 		std::cerr << "Usage: " << argv[0] << " <OPTIONS>\n"
 			"  -s <SAMPLE_RATE>\n"
-                        "  -d <INPUT_DATA_FORMAT> : i8 | i16 | i32 | f32 | f64 (default: i8)\n"
-			"  -D <OUTPUT_DATA_FORMAT> : i8 | i16 | i32 | f32 | f64 (default: i16)\n"
+                        "  -d <INPUT_DATA_FORMAT> : i8 | u8 | i16 | i32 | f16 | f32 | f64 | sc12 (default: i8)\n"
+			"  -D <OUTPUT_DATA_FORMAT> : i8 | u8 | i16 | i32 | f16 | f32 | f64 | sc12 (default: i16)\n"
+			"  -S <SCALING> : raw (values kept) | full (+-1.0 of floats mapped to the integer range, +-2048 for sc12) (default: raw)\n"
 			"  -i <INPUT_CAPTURE_FILE> (default: -)\n"
-			"  -o <OUTPUT_CAPTURE_FILE> (default: -)\n";
+			"  -o <OUTPUT_CAPTURE_FILE> (default: -)\n"
+			"  --stats-interval <SECONDS> : print the I/O and compute counters every SECONDS on stderr (default: on SIGUSR1 only)\n"
+			"  --stats-file <STATS_FILE> : rewrite the counters in STATS_FILE, every second by default\n";
 		return 1;
 	}
+	io_stats_start( argc, argv );
 	const std::string prog_name = argv[0];
 	std::string data_format = "i8";
 	std::string output_data_format = "i16";
+	std::string scaling = "raw";
 	const char* input_capture_file = "-";
 	const char* output_capture_file = "-";
 	for ( int i = 1; i < argc; i += 2 ) {
@@ -74,31 +321,50 @@ int main(int argc, char** argv)
 			data_format = argv[i+1];
 		} else if ( arg == "-D" ) {
 			output_data_format = argv[i+1];
+		} else if ( arg == "-S" ) {
+			scaling = argv[i+1];
 		} else if ( arg == "-i" ) {
 			input_capture_file = argv[i+1];
 		} else if ( arg == "-o" ) {
 			output_capture_file = argv[i+1];
 		}
 	}
+	if ( data_format == "cu8" ) {
+		data_format = "u8";
+	}
         if ( data_format != "i8" &&
+	     data_format != "u8" &&
 	     data_format != "i16" &&
 	     data_format != "i32" &&
+	     data_format != "f16" &&
 	     data_format != "f32" &&
-	     data_format != "f64" ) {
+	     data_format != "f64" &&
+	     data_format != "sc12" ) {
 		std::cerr << prog_name << " : ERROR: please set a valid data format !\n";
 		return 1;
 	}
+	if ( output_data_format == "cu8" ) {
+		output_data_format = "u8";
+	}
 	if ( output_data_format != "i8" &&
+	     output_data_format != "u8" &&
 	     output_data_format != "i16" &&
 	     output_data_format != "i32" &&
+	     output_data_format != "f16" &&
 	     output_data_format != "f32" &&
-	     output_data_format != "f64" ) {
+	     output_data_format != "f64" &&
+	     output_data_format != "sc12" ) {
 		std::cerr << prog_name << " : ERROR: please set a valid output data format !\n";
 		return 1;
 	}
+	if ( scaling != "raw" && scaling != "full" ) {
+		std::cerr << prog_name << " : ERROR: please set a valid scaling !\n";
+		return 1;
+	}
+	const bool full_scale = ( scaling == "full" );
 	FILE* fd_input = stdin;
 	if ( input_capture_file != std::string("-") ) {
-		fd_input = fopen( input_capture_file, "rb" );
+		fd_input = capture_open( input_capture_file, "rb", data_format );
 		if ( fd_input == NULL ) {
 			std::cerr << prog_name << " : ";
 			perror("fopen()");
@@ -107,17 +373,19 @@ int main(int argc, char** argv)
 	}
 	FILE* fd_output = stdout;
 	if ( output_capture_file != std::string("-") ) {
-		fd_output = fopen( output_capture_file, "w+b" );
+		fd_output = capture_open( output_capture_file, "w+b", output_data_format );
 		if ( fd_output == NULL ) {
 			std::cerr << prog_name << " : ";
 			perror("fopen()");
 			return 1;
 		}
 	}
-	if      ( data_format == "i8"  ) { conv<char>( output_data_format, fd_input, fd_output); }
-	else if ( data_format == "i16" ) { conv<short>( output_data_format, fd_input, fd_output); }
-	else if ( data_format == "i32" ) { conv<int>( output_data_format, fd_input, fd_output); }
-	else if ( data_format == "f32" ) { conv<float>( output_data_format, fd_input, fd_output); }
-	else if ( data_format == "f64" ) { conv<double>( output_data_format, fd_input, fd_output); }
+	if      ( data_format == "i8"  ) { conv<char>( output_data_format, full_scale, fd_input, fd_output); }
+	else if ( data_format == "u8"  ) { conv<u8_sample>( output_data_format, full_scale, fd_input, fd_output); }
+	else if ( data_format == "i16" ) { conv<short>( output_data_format, full_scale, fd_input, fd_output); }
+	else if ( data_format == "i32" ) { conv<int>( output_data_format, full_scale, fd_input, fd_output); }
+	else if ( data_format == "f32" ) { conv<float>( output_data_format, full_scale, fd_input, fd_output); }
+	else if ( data_format == "f64" ) { conv<double>( output_data_format, full_scale, fd_input, fd_output); }
+	else { conv_packed( packed_format( data_format ), output_data_format, full_scale, fd_input, fd_output); }
 	return 0;
 }
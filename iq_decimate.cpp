@@ -23,79 +23,801 @@
 
 #include <iostream>
 #include <complex>
+#include <vector>
+#include <algorithm>
+#include <cstdlib>
+#include <cstring>
+#include <limits>
+#include <immintrin.h>
+#include <thread>
+#include <sys/stat.h>
+#include <unistd.h>
+#include "iq_u8.h"
+#include "iq_f16.h"
+#include "iq_capture.h"
+#include "iq_io.h"
 #include "fir.h"
+#include "iq_fir.h"
+#include "iq_fft.h"
+#include "iq_nco.h"
 
 static const double PI = 4 * std::atan(1);
+static const int CIC_ORDER = 4;
+static const int HALFBAND_NB_COEF = 19;
+static const int HALFBAND_MAX_STAGES = 3;
+static const int COMPENSATION_NB_COEF = 24;
+static const unsigned long long CHUNK_LEN = 1 << 20; /* samples per chunk of the block-parallel mode */
 
-template <class T>
-void decimate_scalar( const unsigned int sample_rate, const unsigned int cutoff_frequency, FILE* fd_input, FILE* fd_output )
+/*
+  Decimating FIR keeping its history and decimation phase from one block to
+  the next. Only non-zero coefficients are stored so the half-band stages
+  cost half of their length.
+*/
+template <class S>
+class fir_decimator
 {
-	const int nb_coef = 64;
-	int dec_rate = int(sample_rate / cutoff_frequency);
-	const unsigned int output_sample_rate = sample_rate / dec_rate;
-	std::cerr << "output_sample_rate: " << output_sample_rate << "\n";
-	double avg_coef[ nb_coef ];
-	T* in_buff = new T[ nb_coef + sample_rate ];
-	T* out_buff = new T[ output_sample_rate ];
-	fir_gen( BLACKMAN_WINDOW_TYPE, nb_coef, sample_rate, cutoff_frequency, avg_coef, NULL, NULL );
+public:
+	fir_decimator( const std::vector<double>& coef, unsigned int rate )
+		: rate( rate ), phase( 0 ), hist( coef.size() - 1, S(0) )
+	{
+		for ( unsigned int k = 0; k < coef.size(); k++ ) {
+			if ( coef[ k ] != 0 ) {
+				taps_idx.push_back( k );
+				taps.push_back( coef[ k ] );
+			}
+		}
+	}
+
+	unsigned int length() const { return hist.size() + 1; }
+	unsigned int decimation() const { return rate; }
+
+	/* return the number of samples written to out, at most n / rate + 1 */
+	unsigned int process( const S* in, unsigned int n, S* out )
+	{
+		buff.resize( hist.size() + n );
+		std::copy( hist.begin(), hist.end(), buff.begin() );
+		std::copy( in, in + n, buff.begin() + hist.size() );
+		unsigned int j = 0;
+		for ( unsigned int i = phase; i < n; i += rate ) {
+			const S* p = &buff[ i ];
+			S avg(0);
+			for ( unsigned int k = 0; k < taps.size(); k++ ) {
+				avg += taps[ k ] * p[ taps_idx[ k ] ];
+			}
+			out[ j++ ] = avg;
+		}
+		phase = ( phase + rate - n % rate ) % rate;
+		std::copy( buff.end() - hist.size(), buff.end(), hist.begin() );
+		return j;
+	}
+
+private:
+	unsigned int rate;
+	unsigned int phase;
+	std::vector<S> hist;
+	std::vector<S> buff;
+	std::vector<unsigned int> taps_idx;
+	std::vector<double> taps;
+};
+
+/* response of a CIC_ORDER CIC decimating by dec_rate, f relative to its input rate */
+static double cic_response( unsigned int dec_rate, double f )
+{
+	if ( f == 0 ) {
+		return 1;
+	}
+	return std::pow( std::fabs( std::sin( PI * f * dec_rate ) / ( dec_rate * std::sin( PI * f ) ) ), CIC_ORDER );
+}
+
+/*
+  The CIC is run in its non-recursive form: the (1 + z^-1 + ... + z^-(D-1))^N
+  integer coefficients are applied at the output rate only. This costs about
+  CIC_ORDER multiply-add per input sample like the integrator/comb form, but
+  the float formats do not accumulate any rounding error in the integrators.
+*/
+static std::vector<double> cic_gen( unsigned int dec_rate )
+{
+	std::vector<double> coef( 1, 1 );
+	for ( int n = 0; n < CIC_ORDER; n++ ) {
+		std::vector<double> c( coef.size() + dec_rate - 1, 0 );
+		for ( unsigned int i = 0; i < coef.size(); i++ ) {
+			for ( unsigned int k = 0; k < dec_rate; k++ ) {
+				c[ i + k ] += coef[ i ];
+			}
+		}
+		coef = c;
+	}
+	const double gain = std::pow( double(dec_rate), CIC_ORDER );
+	for ( unsigned int i = 0; i < coef.size(); i++ ) {
+		coef[ i ] /= gain;
+	}
+	return coef;
+}
+
+static double blackman( int i, int nb_coef )
+{
+	return 0.42 - 0.5 * std::cos( 2 * PI * i / ( nb_coef - 1 ) ) + 0.08 * std::cos( 4 * PI * i / ( nb_coef - 1 ) );
+}
+
+/* windowed sinc at a quarter of the rate: every other coefficient is zero */
+static std::vector<double> halfband_gen()
+{
+	std::vector<double> coef( HALFBAND_NB_COEF, 0 );
+	const int c = HALFBAND_NB_COEF / 2;
+	for ( int i = 0; i < HALFBAND_NB_COEF; i++ ) {
+		const int m = i - c;
+		if ( m == 0 ) {
+			coef[ i ] = 0.5;
+		} else if ( m % 2 != 0 ) {
+			coef[ i ] = std::sin( PI * m / 2 ) / ( PI * m ) * blackman( i, HALFBAND_NB_COEF );
+		}
+	}
+	return coef;
+}
+
+/*
+  Low-pass at cutoff (relative to its input rate) whose passband is the
+  inverse of the CIC droop, obtained by frequency sampling then windowing.
+*/
+static std::vector<double> compensation_gen( int nb_coef, double cutoff, unsigned int cic_rate, double cic_scale )
+{
+	const int nb_freq = 512;
+	std::vector<double> coef( nb_coef, 0 );
+	const double c = ( nb_coef - 1 ) / 2.;
+	double sum = 0;
+	for ( int i = 0; i < nb_coef; i++ ) {
+		double v = 0;
+		for ( int k = 0; k < nb_freq; k++ ) {
+			const double f = cutoff * ( k + 0.5 ) / nb_freq;
+			v += std::cos( 2 * PI * f * ( i - c ) ) / cic_response( cic_rate, f * cic_scale );
+		}
+		coef[ i ] = v * blackman( i, nb_coef );
+		sum += coef[ i ];
+	}
 	for ( int i = 0; i < nb_coef; i++ ) {
-		in_buff[ i ] = 0;
-	}
-	while( fread( in_buff + nb_coef, sizeof(*in_buff), sample_rate, fd_input) == sample_rate ) {
-		for ( unsigned int i = 0, j = 0; i < sample_rate; i += dec_rate, j++ ) {
-			const T* p = in_buff + i;
-			double avg = 0;
-			for ( int k = 0; k < nb_coef; k++ ) {
-				avg += avg_coef[ k ] * p[k];
+		coef[ i ] /= sum;
+	}
+	return coef;
+}
+
+/*
+  Split dec_rate into CIC -> half-band stages (each decimating by 2) -> final
+  compensating FIR, each of them running at its own input rate.
+*/
+template <class S>
+class cascade_decimator
+{
+public:
+	/* cutoff_frequency is given relative to the input sample rate */
+	cascade_decimator( unsigned int dec_rate, double cutoff_frequency )
+	{
+		unsigned int fir_rate = 1;
+		if ( dec_rate % 2 == 0 ) {
+			fir_rate = 2;
+		} else {
+			for ( unsigned int p = 3; p <= 7; p += 2 ) {
+				if ( dec_rate % p == 0 ) {
+					fir_rate = p;
+					break;
+				}
 			}
-			out_buff[ j ] = avg;
 		}
-		for ( int i = 0; i < nb_coef; i++ ) {
-			in_buff[ i ] = in_buff[ sample_rate + i ];
+		unsigned int cic_rate = dec_rate / fir_rate;
+		int nb_halfband = 0;
+		while ( nb_halfband < HALFBAND_MAX_STAGES && cic_rate % 2 == 0 ) {
+			cic_rate /= 2;
+			nb_halfband++;
+		}
+		std::cerr << "cascade: cic " << cic_rate << " x halfband " << (1 << nb_halfband) << " x fir " << fir_rate << "\n";
+		if ( cic_rate > 1 ) {
+			stages.push_back( fir_decimator<S>( cic_gen( cic_rate ), cic_rate ) );
 		}
-		fwrite( out_buff, sizeof(*out_buff), output_sample_rate, fd_output );
-                fflush( fd_output );
+		for ( int i = 0; i < nb_halfband; i++ ) {
+			stages.push_back( fir_decimator<S>( halfband_gen(), 2 ) );
+		}
+		const double fir_sample_rate = 1. / ( cic_rate << nb_halfband );
+		stages.push_back( fir_decimator<S>( compensation_gen( COMPENSATION_NB_COEF * fir_rate + 1, cutoff_frequency / fir_sample_rate, cic_rate, fir_sample_rate ), fir_rate ) );
 	}
-	delete[] out_buff;
-	delete[] in_buff;
+
+	/* number of input samples each output depends on */
+	unsigned int memory() const
+	{
+		unsigned int m = 0;
+		unsigned int step = 1;
+		for ( unsigned int i = 0; i < stages.size(); i++ ) {
+			m += ( stages[ i ].length() - 1 ) * step;
+			step *= stages[ i ].decimation();
+		}
+		return m;
+	}
+
+	/* out needs room for n / dec_rate + 1 samples */
+	unsigned int process( const S* in, unsigned int n, S* out )
+	{
+		tmp[0].resize( n + 1 );
+		tmp[1].resize( n + 1 );
+		const S* p = in;
+		for ( unsigned int i = 0; i < stages.size(); i++ ) {
+			S* q = ( i == stages.size() - 1 ) ? out : &tmp[ i % 2 ][0];
+			n = stages[ i ].process( p, n, q );
+			p = q;
+		}
+		return n;
+	}
+
+private:
+	std::vector< fir_decimator<S> > stages;
+	std::vector<S> tmp[2];
+};
+
+/*
+  Parameters shared by the engines below. Every engine keeps its filter
+  history and decimation phase from one block to the next, so the output
+  does not depend on the block size.
+*/
+struct decimate_params
+{
+	unsigned int block_size;
+	int nb_chan;
+	int dec_rate;
+	std::vector<double> coef;
+	double cutoff; /* cascade only, relative to sample_rate */
+	double frequency_mixing; /* ddc only, relative to sample_rate */
+};
+
+/*
+  Every engine provides:
+    process( in, n, out ): filter n <= block_size samples, return the number
+                           written to out, at most n / dec_rate + 1
+    history_len(): number of input samples rebuilding the engine state
+    prime( in, n, start ): load the n <= history_len() samples preceding
+                           the next block, which starts at the input sample
+                           start, a multiple of dec_rate
+*/
+
+/*
+  Direct form decimation of nb_chan interleaved channels: the block is
+  converted once to the accumulation type A into an aligned buffer keeping
+  nb_coef samples of history, then the FIR is evaluated at the output
+  positions only.
+*/
+template <class T, class A>
+class direct_engine
+{
+public:
+	direct_engine( const decimate_params& p )
+		: p( p ), nb_coef( p.coef.size() ), fir( &p.coef[0], p.coef.size(), p.nb_chan ), phase( 0 )
+	{
+		work_len = p.nb_chan * ( nb_coef + p.block_size ) + fir.span();
+		work = (A*) aligned_alloc( SIMD_WIDTH, ( work_len * sizeof(A) + SIMD_WIDTH - 1 ) / SIMD_WIDTH * SIMD_WIDTH );
+		std::fill( work, work + work_len, A(0) );
+	}
+
+	~direct_engine() { free( work ); }
+
+	unsigned int history_len() const { return nb_coef; }
+
+	void prime( const T* in, unsigned int n, unsigned long long )
+	{
+		A* x = work + p.nb_chan * ( nb_coef - n );
+		for ( unsigned int i = 0; i < p.nb_chan * n; i++ ) {
+			x[ i ] = in[ i ];
+		}
+	}
+
+	unsigned int process( const T* in, unsigned int n, T* out )
+	{
+		const int nb_chan = p.nb_chan;
+		A* x = work + nb_chan * nb_coef;
+		for ( unsigned int i = 0; i < nb_chan * n; i++ ) {
+			x[ i ] = in[ i ];
+		}
+		A y[ 2 ] = { 0, 0 };
+		unsigned int j = 0;
+		for ( unsigned int i = phase; i < n; i += p.dec_rate, j++ ) {
+			fir.dot( work + nb_chan * i, y );
+			for ( int c = 0; c < nb_chan; c++ ) {
+				out[ nb_chan*j + c ] = y[ c ];
+			}
+		}
+		phase = ( phase + p.dec_rate - n % p.dec_rate ) % p.dec_rate;
+		std::copy( work + nb_chan * n, work + nb_chan * ( n + nb_coef ), work );
+		return j;
+	}
+
+private:
+	direct_engine( const direct_engine& );
+	const decimate_params& p;
+	const unsigned int nb_coef;
+	simd_fir<A> fir;
+	unsigned int phase;
+	unsigned int work_len;
+	A* work;
+};
+
+/*
+  Digital down-converter: mixing by exp( -j w t ) then decimating is
+    z[t] = exp( -j w t ) * sum_k coef[k] * exp( -j w k ) * x[t+k]
+  so the rotation of the samples is folded into complex coefficients, run
+  as two real FIRs on the interleaved I/Q, and the remaining rotation is
+  generated by an NCO at the output rate only. The output is the one of
+  iq_mix followed by the direct engine.
+*/
+template <class T, class A>
+class ddc_engine
+{
+public:
+	ddc_engine( const decimate_params& p )
+		: p( p ), nb_coef( p.coef.size() ), coef_re( nb_coef ), coef_im( nb_coef ),
+		  osc( - p.frequency_mixing * p.dec_rate, 1 ), phase( 0 ),
+		  rot_re( p.block_size / p.dec_rate + 1 ), rot_im( p.block_size / p.dec_rate + 1 )
+	{
+		/* the first sample of the work buffer is the input sample -nb_coef */
+		for ( int k = 0; k < nb_coef; k++ ) {
+			const std::complex<double> c = std::polar( p.coef[ k ], -2 * PI * p.frequency_mixing * ( k - nb_coef ) );
+			coef_re[ k ] = c.real();
+			coef_im[ k ] = c.imag();
+		}
+		fir_re = new simd_fir<A>( &coef_re[0], nb_coef, 2 );
+		fir_im = new simd_fir<A>( &coef_im[0], nb_coef, 2 );
+		work_len = 2 * ( nb_coef + p.block_size ) + fir_re->span();
+		work = (A*) aligned_alloc( SIMD_WIDTH, ( work_len * sizeof(A) + SIMD_WIDTH - 1 ) / SIMD_WIDTH * SIMD_WIDTH );
+		std::fill( work, work + work_len, A(0) );
+	}
+
+	~ddc_engine()
+	{
+		free( work );
+		delete fir_im;
+		delete fir_re;
+	}
+
+	unsigned int history_len() const { return nb_coef; }
+
+	void prime( const T* in, unsigned int n, unsigned long long start )
+	{
+		A* x = work + 2 * ( nb_coef - n );
+		for ( unsigned int i = 0; i < 2 * n; i++ ) {
+			x[ i ] = in[ i ];
+		}
+		osc.skip( start / p.dec_rate );
+	}
+
+	unsigned int process( const T* in, unsigned int n, T* out )
+	{
+		A* x = work + 2 * nb_coef;
+		for ( unsigned int i = 0; i < 2 * n; i++ ) {
+			x[ i ] = in[ i ];
+		}
+		const unsigned int nb_output = ( phase < n ) ? ( n - phase + p.dec_rate - 1 ) / p.dec_rate : 0;
+		osc.generate( &rot_re[0], &rot_im[0], nb_output );
+		A a[ 2 ] = { 0, 0 }, b[ 2 ] = { 0, 0 };
+		for ( unsigned int i = phase, j = 0; j < nb_output; i += p.dec_rate, j++ ) {
+			fir_re->dot( work + 2 * i, a );
+			fir_im->dot( work + 2 * i, b );
+			const double re = a[ 0 ] - b[ 1 ];
+			const double im = a[ 1 ] + b[ 0 ];
+			out[ 2*j ] = re * rot_re[ j ] - im * rot_im[ j ];
+			out[ 2*j+1 ] = re * rot_im[ j ] + im * rot_re[ j ];
+		}
+		phase = ( phase + p.dec_rate - n % p.dec_rate ) % p.dec_rate;
+		std::copy( work + 2 * n, work + 2 * ( n + nb_coef ), work );
+		return nb_output;
+	}
+
+private:
+	ddc_engine( const ddc_engine& );
+	const decimate_params& p;
+	const int nb_coef;
+	std::vector<double> coef_re;
+	std::vector<double> coef_im;
+	simd_fir<A>* fir_re;
+	simd_fir<A>* fir_im;
+	nco osc;
+	unsigned int phase;
+	std::vector<double> rot_re;
+	std::vector<double> rot_im;
+	unsigned int work_len;
+	A* work;
+};
+
+/*
+  Fixed point int16 dot product: Q15 coefficients, int16 x int16 products
+  summed by pairs into int32 (pmaddwd). n is a multiple of 16 and h is
+  aligned on SIMD_WIDTH bytes.
+*/
+static int dot_q15( const short* x, const short* h, int n )
+{
+#if defined(__AVX2__)
+	__m256i acc = _mm256_setzero_si256();
+	for ( int k = 0; k < n; k += 16 ) {
+		const __m256i v = _mm256_loadu_si256( (const __m256i*)( x + k ) );
+		acc = _mm256_add_epi32( acc, _mm256_madd_epi16( v, _mm256_load_si256( (const __m256i*)( h + k ) ) ) );
+	}
+	__m128i acc4 = _mm_add_epi32( _mm256_castsi256_si128( acc ), _mm256_extracti128_si256( acc, 1 ) );
+#elif defined(__SSE2__)
+	__m128i acc4 = _mm_setzero_si128();
+	for ( int k = 0; k < n; k += 8 ) {
+		const __m128i v = _mm_loadu_si128( (const __m128i*)( x + k ) );
+		acc4 = _mm_add_epi32( acc4, _mm_madd_epi16( v, _mm_load_si128( (const __m128i*)( h + k ) ) ) );
+	}
+#endif
+#if defined(__SSE2__)
+	acc4 = _mm_add_epi32( acc4, _mm_shuffle_epi32( acc4, _MM_SHUFFLE( 1, 0, 3, 2 ) ) );
+	acc4 = _mm_add_epi32( acc4, _mm_shuffle_epi32( acc4, _MM_SHUFFLE( 2, 3, 0, 1 ) ) );
+	return _mm_cvtsi128_si32( acc4 );
+#else
+	int acc = 0;
+	for ( int k = 0; k < n; k++ ) {
+		acc += int( x[ k ] ) * h[ k ];
+	}
+	return acc;
+#endif
 }
 
+/*
+  Integer datapath for i8 / i16 samples only: the channels are deinterleaved
+  into int16 planes and filtered with Q15 coefficients. The output is
+  rounded half up ( (acc + 2^14) >> 15 ) then saturated to the range of T.
+  As |acc| <= 2^15 * sum(|q15 coef|), the int32 accumulator cannot
+  overflow while the sum of the absolute coefficients stays below 2.
+*/
 template <class T>
-void decimate_iq( const unsigned int sample_rate, const unsigned int cutoff_frequency, FILE* fd_input, FILE* fd_output )
+class q15_engine
 {
-	const int nb_coef = 64;
-	int dec_rate = int(sample_rate / cutoff_frequency);
-	const unsigned int output_sample_rate = sample_rate / dec_rate;
-	std::cerr << "output_sample_rate: " << output_sample_rate << "\n";
-	double avg_coef[ nb_coef ];
-	T* in_buff = new T[ 2*(nb_coef + sample_rate) ];
-	T* out_buff = new T[ 2*output_sample_rate ];
-	fir_gen( BLACKMAN_WINDOW_TYPE, nb_coef, sample_rate, cutoff_frequency/2, avg_coef, NULL, NULL );
-	for ( int i = 0; i < nb_coef; i++ ) {
-		in_buff[ 2*i ] = 0;
-		in_buff[ 2*i+1 ] = 0;
-	}
-	while( fread( in_buff + 2*nb_coef, 2*sizeof(*in_buff), sample_rate, fd_input) == sample_rate ) {
-		for ( unsigned int i = 0, j = 0; i < sample_rate; i += dec_rate, j++ ) {
-			const T* p = in_buff + 2*i;
-			std::complex<double> avg(0, 0);
-			for ( int k = 0; k < nb_coef; k++ ) {
-				std::complex<double> c( p[2*k], p[2*k+1] );
-				avg += avg_coef[ k ] * c;
+public:
+	q15_engine( const decimate_params& p )
+		: p( p ), nb_coef( p.coef.size() ), nb_pad( ( nb_coef + 15 ) / 16 * 16 ), phase( 0 )
+	{
+		const unsigned int plane_len = nb_coef + p.block_size + nb_pad;
+		coef = (short*) aligned_alloc( SIMD_WIDTH, nb_pad * sizeof(short) );
+		for ( int k = 0; k < nb_pad; k++ ) {
+			const double q = ( k < nb_coef ) ? std::floor( p.coef[ k ] * 32768 + 0.5 ) : 0;
+			coef[ k ] = std::max( -32768., std::min( 32767., q ) );
+		}
+		for ( int c = 0; c < p.nb_chan; c++ ) {
+			plane[ c ] = (short*) aligned_alloc( SIMD_WIDTH, ( plane_len * sizeof(short) + SIMD_WIDTH - 1 ) / SIMD_WIDTH * SIMD_WIDTH );
+			std::fill( plane[ c ], plane[ c ] + plane_len, 0 );
+		}
+	}
+
+	~q15_engine()
+	{
+		for ( int c = 0; c < p.nb_chan; c++ ) {
+			free( plane[ c ] );
+		}
+		free( coef );
+	}
+
+	/* true if the coefficients cannot overflow the int32 accumulator */
+	static bool is_safe( const std::vector<double>& coef )
+	{
+		double sum = 0;
+		for ( unsigned int k = 0; k < coef.size(); k++ ) {
+			sum += std::fabs( coef[ k ] );
+		}
+		return sum < 2;
+	}
+
+	unsigned int history_len() const { return nb_coef; }
+
+	void prime( const T* in, unsigned int n, unsigned long long )
+	{
+		load( in, n, nb_coef - n );
+	}
+
+	unsigned int process( const T* in, unsigned int n, T* out )
+	{
+		const int nb_chan = p.nb_chan;
+		const int out_min = ( sizeof(T) == 1 ) ? std::numeric_limits<signed char>::min() : std::numeric_limits<short>::min();
+		const int out_max = ( sizeof(T) == 1 ) ? std::numeric_limits<signed char>::max() : std::numeric_limits<short>::max();
+		load( in, n, nb_coef );
+		unsigned int nb_output = 0;
+		for ( int c = 0; c < nb_chan; c++ ) {
+			const short* x = plane[ c ];
+			nb_output = 0;
+			for ( unsigned int i = phase, j = c; i < n; i += p.dec_rate, j += nb_chan ) {
+				const int acc = ( dot_q15( x + i, coef, nb_pad ) + (1 << 14) ) >> 15;
+				out[ j ] = std::max( out_min, std::min( out_max, acc ) );
+				nb_output++;
+			}
+		}
+		phase = ( phase + p.dec_rate - n % p.dec_rate ) % p.dec_rate;
+		for ( int c = 0; c < nb_chan; c++ ) {
+			std::copy( plane[ c ] + n, plane[ c ] + n + nb_coef, plane[ c ] );
+		}
+		return nb_output;
+	}
+
+private:
+	q15_engine( const q15_engine& );
+
+	void load( const T* in, unsigned int n, unsigned int pos )
+	{
+		if ( p.nb_chan == 1 ) {
+			std::copy( in, in + n, plane[ 0 ] + pos );
+		} else {
+			short* x = plane[ 0 ] + pos;
+			short* y = plane[ 1 ] + pos;
+			for ( unsigned int i = 0; i < n; i++ ) {
+				x[ i ] = in[ 2*i ];
+				y[ i ] = in[ 2*i+1 ];
 			}
-			out_buff[ 2*j ] = avg.real();
-			out_buff[ 2*j+1 ] = avg.imag();
 		}
-		for ( int i = 0; i < nb_coef; i++ ) {
-			in_buff[ 2*i ] = in_buff[ 2*sample_rate + 2*i ];
-			in_buff[ 2*i+1 ] = in_buff[ 2*sample_rate + 2*i+1 ];
+	}
+
+	const decimate_params& p;
+	const int nb_coef;
+	const int nb_pad;
+	unsigned int phase;
+	short* coef;
+	short* plane[ 2 ];
+};
+
+/*
+  Overlap-save decimation: the FFT filter computes the whole block at the
+  input rate but its cost per sample grows with log(nb_coef) only.
+*/
+template <class T, class S>
+class fft_engine
+{
+public:
+	fft_engine( const decimate_params& p )
+		: p( p ), nb_coef( p.coef.size() ), filter( &p.coef[0], p.coef.size() ),
+		  work( nb_coef + p.block_size + 2 * fft_filter<S>::fft_size_for( nb_coef ), S(0) ),
+		  y( p.block_size / p.dec_rate + 1 ), phase( 0 )
+	{
+	}
+
+	unsigned int history_len() const { return nb_coef; }
+
+	void prime( const T* in, unsigned int n, unsigned long long )
+	{
+		double* x = reinterpret_cast<double*>( &work[ nb_coef - n ] );
+		for ( unsigned int i = 0; i < p.nb_chan * n; i++ ) {
+			x[ i ] = in[ i ];
 		}
-		fwrite( out_buff, 2*sizeof(*out_buff), output_sample_rate, fd_output );
+	}
+
+	unsigned int process( const T* in, unsigned int n, T* out )
+	{
+		double* x = reinterpret_cast<double*>( &work[ nb_coef ] );
+		for ( unsigned int i = 0; i < p.nb_chan * n; i++ ) {
+			x[ i ] = in[ i ];
+		}
+		/* the last segment reads past the block: zero it so the rounding does not depend on the previous blocks */
+		std::fill( work.begin() + nb_coef + n, work.end(), S(0) );
+		const unsigned int nb_output = ( phase < n ) ? filter.process( &work[ phase ], n - phase, p.dec_rate, &y[0] ) : 0;
+		phase = ( phase + p.dec_rate - n % p.dec_rate ) % p.dec_rate;
+		const double* v = reinterpret_cast<const double*>( &y[0] );
+		for ( unsigned int j = 0; j < p.nb_chan * nb_output; j++ ) {
+			out[ j ] = v[ j ];
+		}
+		std::copy( work.begin() + n, work.begin() + n + nb_coef, work.begin() );
+		return nb_output;
+	}
+
+private:
+	const decimate_params& p;
+	const unsigned int nb_coef;
+	fft_filter<S> filter;
+	std::vector<S> work;
+	std::vector<S> y;
+	unsigned int phase;
+};
+
+/* S is double for the scalar signals, std::complex<double> for the iq ones */
+template <class T, class S>
+class cascade_engine
+{
+public:
+	cascade_engine( const decimate_params& p )
+		: p( p ), cascade( p.dec_rate, p.cutoff ), x( p.block_size ), y( p.block_size / p.dec_rate + 1 )
+	{
+	}
+
+	/* the state is rebuilt by running the cascade over its whole memory, on its phase */
+	unsigned int history_len() const
+	{
+		return ( cascade.memory() + p.dec_rate - 1 ) / p.dec_rate * p.dec_rate;
+	}
+
+	void prime( const T* in, unsigned int n, unsigned long long )
+	{
+		std::vector<T> out( p.nb_chan * ( p.block_size / p.dec_rate + 1 ) );
+		for ( unsigned int i = 0; i < n; i += p.block_size ) {
+			process( in + p.nb_chan * i, std::min( p.block_size, n - i ), &out[0] );
+		}
+	}
+
+	unsigned int process( const T* in, unsigned int n, T* out )
+	{
+		double* v = reinterpret_cast<double*>( &x[0] );
+		for ( unsigned int i = 0; i < p.nb_chan * n; i++ ) {
+			v[ i ] = in[ i ];
+		}
+		const unsigned int nb_output = cascade.process( &x[0], n, &y[0] );
+		const double* w = reinterpret_cast<const double*>( &y[0] );
+		for ( unsigned int j = 0; j < p.nb_chan * nb_output; j++ ) {
+			out[ j ] = w[ j ];
+		}
+		return nb_output;
+	}
+
+private:
+	const decimate_params& p;
+	cascade_decimator<S> cascade;
+	std::vector<S> x;
+	std::vector<S> y;
+};
+
+template <class T, class E>
+void decimate_stream( const decimate_params& p, FILE* fd_input, FILE* fd_output )
+{
+	E engine( p );
+	T* in_buff = new T[ p.nb_chan * p.block_size ];
+	T* out_buff = new T[ p.nb_chan * ( p.block_size / p.dec_rate + 1 ) ];
+	size_t n;
+	while( ( n = io_read( in_buff, p.nb_chan*sizeof(*in_buff), p.block_size, fd_input) ) > 0 ) {
+		const unsigned int nb_output = engine.process( in_buff, n, out_buff );
+		io_write( out_buff, p.nb_chan*sizeof(*out_buff), nb_output, fd_output );
+		io_flush( fd_output );
 	}
 	delete[] out_buff;
 	delete[] in_buff;
 }
 
+/* read exactly len bytes at offset, return false on error or end of file */
+static bool pread_full( int fd, void* buff, size_t len, off_t offset )
+{
+	char* p = (char*) buff;
+	while ( len > 0 ) {
+		const ssize_t r = pread( fd, p, len, offset );
+		if ( r <= 0 ) {
+			return false;
+		}
+		p += r;
+		offset += r;
+		len -= r;
+	}
+	return true;
+}
+
+template <class T>
+struct chunk_result
+{
+	std::vector<T> out;
+	bool ok;
+};
+
+/*
+  Decimate the input samples [start, start+len) of the file into out. The
+  engine state at start is rebuilt from the history_len() preceding
+  samples, so the output is identical to the one of the sequential run.
+*/
+template <class T, class E>
+void decimate_chunk( const decimate_params* p, int fd, off_t offset, unsigned long long start, unsigned long long len, chunk_result<T>* res )
+{
+	E engine( *p );
+	const unsigned int nb_chan = p->nb_chan;
+	const unsigned long long h = std::min<unsigned long long>( engine.history_len(), start );
+	std::vector<T> in( nb_chan * ( h + len ) );
+	std::vector<T>* out = &res->out;
+	res->ok = pread_full( fd, &in[0], in.size() * sizeof(T), offset + ( start - h ) * nb_chan * sizeof(T) );
+	if ( !res->ok ) {
+		return;
+	}
+	engine.prime( &in[0], h, start );
+	out->resize( nb_chan * ( len / p->dec_rate + len / p->block_size + 2 ) );
+	unsigned long long nb_output = 0;
+	for ( unsigned long long i = 0; i < len; i += p->block_size ) {
+		const unsigned int n = std::min<unsigned long long>( p->block_size, len - i );
+		nb_output += engine.process( &in[ nb_chan * ( h + i ) ], n, &(*out)[ nb_chan * nb_output ] );
+	}
+	out->resize( nb_chan * nb_output );
+}
+
+/*
+  Block-parallel decimation of a regular file: the input is split into
+  chunks starting on a multiple of both block_size and dec_rate, filtered
+  by nb_threads workers reading with pread(), a round of chunks being
+  written in order while the next one is computed. Returns 1 on a read
+  error, the output being then truncated.
+*/
+template <class T, class E>
+int decimate_parallel( const decimate_params& p, int nb_threads, FILE* fd_input, FILE* fd_output )
+{
+	const int fd = fileno( fd_input );
+	const off_t offset = ftello( fd_input );
+	struct stat st;
+	fstat( fd, &st );
+	const unsigned long long frame = p.nb_chan * sizeof(T);
+	const unsigned long long nb_sample = ( st.st_size - offset ) / frame;
+	/* chunks are also aligned on the blocks, the fft segmentation follows them */
+	unsigned long long align = p.block_size;
+	while ( align % p.dec_rate != 0 ) {
+		align += p.block_size;
+	}
+	const unsigned long long chunk_len = std::max<unsigned long long>( 1, CHUNK_LEN / align ) * align;
+	const unsigned long long nb_chunk = ( nb_sample + chunk_len - 1 ) / chunk_len;
+	std::vector< chunk_result<T> > running( nb_threads ), done;
+	for ( unsigned long long first = 0; first < nb_chunk || !done.empty(); first += nb_threads ) {
+		std::vector<std::thread> workers;
+		for ( int t = 0; t < nb_threads && first + t < nb_chunk; t++ ) {
+			const unsigned long long start = ( first + t ) * chunk_len;
+			const unsigned long long len = std::min( chunk_len, nb_sample - start );
+			workers.push_back( std::thread( decimate_chunk<T,E>, &p, fd, offset, start, len, &running[ t ] ) );
+		}
+		for ( unsigned int t = 0; t < done.size(); t++ ) {
+			if ( !done[ t ].ok ) {
+				std::cerr << "pread(): read error\n";
+				for ( unsigned int w = 0; w < workers.size(); w++ ) {
+					workers[ w ].join();
+				}
+				return 1;
+			}
+			io_write( &done[ t ].out[0], frame, done[ t ].out.size() / p.nb_chan, fd_output );
+		}
+		io_flush( fd_output );
+		for ( unsigned int w = 0; w < workers.size(); w++ ) {
+			workers[ w ].join();
+		}
+		done.assign( running.begin(), running.begin() + workers.size() );
+	}
+	return 0;
+}
+
+template <class T, class E>
+int decimate_run( const decimate_params& p, int nb_threads, FILE* fd_input, FILE* fd_output )
+{
+	struct stat st;
+	if ( nb_threads > 1 && fstat( fileno( fd_input ), &st ) == 0 && S_ISREG( st.st_mode ) ) {
+		return decimate_parallel<T,E>( p, nb_threads, fd_input, fd_output );
+	}
+	if ( nb_threads > 1 ) {
+		std::cerr << "threads: input is not a regular file, decimate sequentially\n";
+	}
+	decimate_stream<T,E>( p, fd_input, fd_output );
+	return 0;
+}
+
+template <class T>
+int decimate( const std::string& filter_engine, const std::string& accumulation, const double frequency_mixing, const int nb_coef, const int nb_threads, const unsigned int block_size, const std::string& signal_type, const unsigned int sample_rate, const unsigned int cutoff_frequency, FILE* fd_input, FILE* fd_output )
+{
+	decimate_params p;
+	p.block_size = block_size;
+	p.nb_chan = ( signal_type == "scalar" ) ? 1 : 2;
+	p.dec_rate = int(sample_rate / cutoff_frequency);
+	const unsigned int output_sample_rate = sample_rate / p.dec_rate;
+	std::cerr << "output_sample_rate: " << output_sample_rate << "\n";
+	if ( filter_engine == "cascade" ) {
+		const double cutoff = ( p.nb_chan == 1 ) ? cutoff_frequency : cutoff_frequency / 2.;
+		p.cutoff = std::min( cutoff, 0.5 * output_sample_rate ) / sample_rate;
+		if ( p.nb_chan == 1 ) { return decimate_run< T, cascade_engine<T, double> >( p, nb_threads, fd_input, fd_output ); }
+		else                  { return decimate_run< T, cascade_engine<T, std::complex<double> > >( p, nb_threads, fd_input, fd_output ); }
+	}
+	p.coef.resize( nb_coef );
+	fir_gen( BLACKMAN_WINDOW_TYPE, nb_coef, sample_rate, ( p.nb_chan == 1 ) ? cutoff_frequency : cutoff_frequency/2, &p.coef[0], NULL, NULL );
+	if ( frequency_mixing != 0 ) {
+		std::cerr << "engine: ddc\n";
+		p.frequency_mixing = frequency_mixing / sample_rate;
+		if ( accumulation == "f32" ) { return decimate_run< T, ddc_engine<T, float> >( p, nb_threads, fd_input, fd_output ); }
+		else                         { return decimate_run< T, ddc_engine<T, double> >( p, nb_threads, fd_input, fd_output ); }
+	}
+	if ( filter_engine == "fft" || ( filter_engine == "auto" && accumulation == "f64" && fft_is_faster( nb_coef, p.nb_chan, p.dec_rate ) ) ) {
+		std::cerr << "engine: fft\n";
+		if ( p.nb_chan == 1 ) { return decimate_run< T, fft_engine<T, double> >( p, nb_threads, fd_input, fd_output ); }
+		else                  { return decimate_run< T, fft_engine<T, std::complex<double> > >( p, nb_threads, fd_input, fd_output ); }
+	}
+	if ( accumulation == "q15" ) {
+		if ( q15_engine<T>::is_safe( p.coef ) ) {
+			return decimate_run< T, q15_engine<T> >( p, nb_threads, fd_input, fd_output );
+		}
+		std::cerr << "q15: sum of the absolute coefficients too large, fall back to f64\n";
+	}
+	if ( accumulation == "f32" ) { return decimate_run< T, direct_engine<T, float> >( p, nb_threads, fd_input, fd_output ); }
+	else                         { return decimate_run< T, direct_engine<T, double> >( p, nb_threads, fd_input, fd_output ); }
+}
 
 int main(int argc, char** argv)
 {
@@ -104,16 +826,31 @@ int main(int argc, char** argv)
 			"  -s <SAMPLE_RATE>\n"
 			"  -f <CUTOFF_FREQUENCY>\n"
 			"  -t <SIGNAL_TYPE> : scalar | iq (default: iq)\n"
-                        "  -d <DATA_FORMAT> : i8 | i16 | i32 | f32 | f64 (default: i16)\n"
+			"  -e <FILTER_ENGINE> : auto | direct | fft | cascade (default: auto)\n"
+			"  -m <FREQUENCY_MIXING> : iq only, mix by -FREQUENCY_MIXING within the direct engine (default: 0)\n"
+			"  -n <NB_COEF> : direct and fft engines (default: 64)\n"
+			"  -p <ACCUMULATION> : f64 | f32 | q15 (i8, u8 and i16 only), direct engine only (default: f64)\n"
+			"  -j <NB_THREADS> : parallel decimation of a regular input file (default: 1)\n"
+			"  -b <BLOCK_SIZE> : samples per block, lower for less latency (default: SAMPLE_RATE)\n"
+                        "  -d <DATA_FORMAT> : i8 | u8 | i16 | i32 | f16 | f32 | f64 (default: i16)\n"
 			"  -i <INPUT_CAPTURE_FILE> (default: -)\n"
-			"  -o <OUTPUT_CAPTURE_FILE> (default: -)\n";
+			"  -o <OUTPUT_CAPTURE_FILE> (default: -)\n"
+			"  --stats-interval <SECONDS> : print the I/O and compute counters every SECONDS on stderr (default: on SIGUSR1 only)\n"
+			"  --stats-file <STATS_FILE> : rewrite the counters in STATS_FILE, every second by default\n";
 		return 1;
 	}
+	io_stats_start( argc, argv );
         const std::string prog_name = argv[0];
 	unsigned int sample_rate = 0;
 	unsigned int cutoff_frequency = 0;
 	std::string data_format = "i16";
 	std::string signal_type = "iq";
+	std::string filter_engine = "auto";
+	int nb_coef = 64;
+	std::string accumulation = "f64";
+	double frequency_mixing = 0;
+	int nb_threads = 1;
+	int block_size = 0;
 	const char* input_capture_file = "-";
 	const char* output_capture_file = "-";
 	for ( int i = 1; i < argc; i += 2 ) {
@@ -124,6 +861,18 @@ int main(int argc, char** argv)
 			cutoff_frequency = atof( argv[i+1] );
 		} else if ( arg == "-t" ) {
 			signal_type = argv[i+1];
+		} else if ( arg == "-e" ) {
+			filter_engine = argv[i+1];
+		} else if ( arg == "-m" ) {
+			frequency_mixing = atof( argv[i+1] );
+		} else if ( arg == "-n" ) {
+			nb_coef = atoi( argv[i+1] );
+		} else if ( arg == "-p" ) {
+			accumulation = argv[i+1];
+		} else if ( arg == "-j" ) {
+			nb_threads = atoi( argv[i+1] );
+		} else if ( arg == "-b" ) {
+			block_size = atoi( argv[i+1] );
 		} else if ( arg == "-d" ) {
 			data_format = argv[i+1];
 		} else if ( arg == "-i" ) {
@@ -136,9 +885,14 @@ int main(int argc, char** argv)
 		std::cerr << prog_name << " : ERROR: please set a valid sample rate !\n";
 		return 1;
 	}
+	if ( data_format == "cu8" ) {
+		data_format = "u8";
+	}
         if ( data_format != "i8" &&
+	     data_format != "u8" &&
 	     data_format != "i16" &&
 	     data_format != "i32" &&
+	     data_format != "f16" &&
 	     data_format != "f32" &&
 	     data_format != "f64" ) {
 		std::cerr << prog_name << " : ERROR: please set a valid data format !\n";
@@ -152,9 +906,40 @@ int main(int argc, char** argv)
 		std::cerr << prog_name << " : ERROR: please set a valid signal type !\n";
 		return 1;
 	}
+	if ( filter_engine != "auto" && filter_engine != "direct" && filter_engine != "fft" && filter_engine != "cascade" ) {
+		std::cerr << prog_name << " : ERROR: please set a valid filter engine !\n";
+		return 1;
+	}
+	if ( accumulation != "f64" && accumulation != "f32" && accumulation != "q15" ) {
+		std::cerr << prog_name << " : ERROR: please set a valid accumulation !\n";
+		return 1;
+	}
+	if ( frequency_mixing != 0 && ( signal_type != "iq" || ( filter_engine != "auto" && filter_engine != "direct" ) || accumulation == "q15" ) ) {
+		std::cerr << prog_name << " : ERROR: frequency mixing is only available for iq signals with the direct engine and f64 or f32 accumulation !\n";
+		return 1;
+	}
+	if ( nb_coef <= 0 ) {
+		std::cerr << prog_name << " : ERROR: please set a valid number of coefficients !\n";
+		return 1;
+	}
+	if ( nb_threads <= 0 ) {
+		std::cerr << prog_name << " : ERROR: please set a valid number of threads !\n";
+		return 1;
+	}
+	if ( block_size < 0 ) {
+		std::cerr << prog_name << " : ERROR: please set a valid block size !\n";
+		return 1;
+	}
+	if ( block_size == 0 ) {
+		block_size = sample_rate;
+	}
+	if ( accumulation == "q15" && data_format != "i8" && data_format != "u8" && data_format != "i16" ) {
+		std::cerr << prog_name << " : ERROR: q15 accumulation is only available for i8, u8 and i16 data formats !\n";
+		return 1;
+	}
 	FILE* fd_input = stdin;
 	if ( input_capture_file != std::string("-") ) {
-		fd_input = fopen( input_capture_file, "rb" );
+		fd_input = capture_open( input_capture_file, "rb", data_format );
 		if ( fd_input == NULL ) {
 			std::cerr << prog_name << " : ";
 			perror("fopen()");
@@ -163,25 +948,20 @@ int main(int argc, char** argv)
 	}
 	FILE* fd_output = stdout;
 	if ( output_capture_file != std::string("-") ) {
-		fd_output = fopen( output_capture_file, "w+b" );
+		fd_output = capture_open( output_capture_file, "w+b", data_format );
 		if ( fd_output == NULL ) {
 			std::cerr << prog_name << " : ";
 			perror("fopen()");
 			return 1;
 		}
 	}
-	if ( signal_type == "scalar" ) {
-		if      ( data_format == "i8"  ) { decimate_scalar<char>( sample_rate, cutoff_frequency, fd_input, fd_output); }
-		else if ( data_format == "i16" ) { decimate_scalar<short>( sample_rate, cutoff_frequency, fd_input, fd_output); }
-		else if ( data_format == "i32" ) { decimate_scalar<int>( sample_rate, cutoff_frequency, fd_input, fd_output); }
-		else if ( data_format == "f32" ) { decimate_scalar<float>( sample_rate, cutoff_frequency, fd_input, fd_output); }
-		else if ( data_format == "f64" ) { decimate_scalar<double>( sample_rate, cutoff_frequency, fd_input, fd_output); }
-	} else {
-		if      ( data_format == "i8"  ) { decimate_iq<char>( sample_rate, cutoff_frequency, fd_input, fd_output); }
-		else if ( data_format == "i16" ) { decimate_iq<short>( sample_rate, cutoff_frequency, fd_input, fd_output); }
-		else if ( data_format == "i32" ) { decimate_iq<int>( sample_rate, cutoff_frequency, fd_input, fd_output); }
-		else if ( data_format == "f32" ) { decimate_iq<float>( sample_rate, cutoff_frequency, fd_input, fd_output); }
-		else if ( data_format == "f64" ) { decimate_iq<double>( sample_rate, cutoff_frequency, fd_input, fd_output); }
-	}
-	return 0;
+	int r = 0;
+	if      ( data_format == "i8"  ) { r = decimate<char>( filter_engine, accumulation, frequency_mixing, nb_coef, nb_threads, block_size, signal_type, sample_rate, cutoff_frequency, fd_input, fd_output); }
+	else if ( data_format == "u8"  ) { r = decimate<u8_sample>( filter_engine, accumulation, frequency_mixing, nb_coef, nb_threads, block_size, signal_type, sample_rate, cutoff_frequency, fd_input, fd_output); }
+	else if ( data_format == "i16" ) { r = decimate<short>( filter_engine, accumulation, frequency_mixing, nb_coef, nb_threads, block_size, signal_type, sample_rate, cutoff_frequency, fd_input, fd_output); }
+	else if ( data_format == "i32" ) { r = decimate<int>( filter_engine, accumulation, frequency_mixing, nb_coef, nb_threads, block_size, signal_type, sample_rate, cutoff_frequency, fd_input, fd_output); }
+	else if ( data_format == "f16" ) { r = decimate<f16_sample>( filter_engine, accumulation, frequency_mixing, nb_coef, nb_threads, block_size, signal_type, sample_rate, cutoff_frequency, fd_input, fd_output); }
+	else if ( data_format == "f32" ) { r = decimate<float>( filter_engine, accumulation, frequency_mixing, nb_coef, nb_threads, block_size, signal_type, sample_rate, cutoff_frequency, fd_input, fd_output); }
+	else if ( data_format == "f64" ) { r = decimate<double>( filter_engine, accumulation, frequency_mixing, nb_coef, nb_threads, block_size, signal_type, sample_rate, cutoff_frequency, fd_input, fd_output); }
+	return r;
 }
@@ -22,55 +22,11 @@
 */
 
 #include <iostream>
-#include <complex>
-
-static const double PI = 4 * std::atan(1);
-
-template <class T>
-void deemphasis_scalar( const unsigned int sample_rate, const double a, const double b, FILE* fd_input, FILE* fd_output )
-{
-        T* in_buff = new T[ sample_rate ];
-        T* out_buff = new T[ sample_rate ];
-	double x_prev = 0;
-	double y_prev = 0;
-        while( fread( in_buff, sizeof(*in_buff), sample_rate, fd_input) == sample_rate ) {
-                for ( unsigned int i = 0; i < sample_rate; i++ ) {
-			double x = in_buff[ i ];
-			double y = a * x + a * x_prev + b * y_prev;
-                        out_buff[ i ] = y;
-			y_prev = y;
-			x_prev = x;
-                }
-                fwrite( out_buff, sizeof(*out_buff), sample_rate, fd_output );
-                fflush( fd_output );
-        }
-        delete[] out_buff;
-        delete[] in_buff;
-}
-
-template <class T>
-void deemphasis_iq( const unsigned int sample_rate, const double a, const double b, FILE* fd_input, FILE* fd_output )
-{
-        T* in_buff = new T[ 2 * sample_rate ];
-        T* out_buff = new T[ 2 * sample_rate ];
-	std::complex< double > x_prev( 0, 0 );
-	std::complex< double > y_prev( 0, 0 );
-        while( fread( in_buff, 2*sizeof(*in_buff), sample_rate, fd_input) == sample_rate ) {
-                for ( unsigned int i = 0; i < sample_rate; i++ ) {
-			std::complex<double> x( in_buff[ 2*i ], in_buff[ 2*i+1 ] );
-			std::complex<double> y = a * x + a * x_prev + b * y_prev;
-			out_buff[ 2*i ] = y.real();
-			out_buff[ 2*i+1 ] = y.imag();
-			y_prev = y;
-			x_prev = x;
-                }
-                fwrite( out_buff, 2*sizeof(*out_buff), sample_rate, fd_output );
-        }
-        delete[] out_buff;
-        delete[] in_buff;
-}
-
-
+#include "iq_u8.h"
+#include "iq_f16.h"
+#include "iq_capture.h"
+#include "iq_io.h"
+#include "iq_iir.h"
 
 int main(int argc, char** argv)
 {
@@ -79,16 +35,21 @@ int main(int argc, char** argv)
 			"  -s <SAMPLE_RATE>\n"
 			"  -r <RC_TIME_CONSTANT> (default: 50e-6)\n"
 			"  -t <SIGNAL_TYPE> : scalar | iq (default: scalar)\n"
-			"  -d <DATA_FORMAT> : i8 | i16 | i32 | f32 | f64 (default: f32)\n"
+			"  -b <BLOCK_SIZE> : samples per block, lower for less latency (default: SAMPLE_RATE)\n"
+			"  -d <DATA_FORMAT> : i8 | u8 | i16 | i32 | f16 | f32 | f64 (default: f32)\n"
 			"  -i <INPUT_CAPTURE_FILE> (default: -)\n"
-			"  -o <OUTPUT_CAPTURE_FILE> (default: -)\n";
+			"  -o <OUTPUT_CAPTURE_FILE> (default: -)\n"
+			"  --stats-interval <SECONDS> : print the I/O and compute counters every SECONDS on stderr (default: on SIGUSR1 only)\n"
+			"  --stats-file <STATS_FILE> : rewrite the counters in STATS_FILE, every second by default\n";
 		return 1;
 	}
+	io_stats_start( argc, argv );
         const std::string prog_name = argv[0];
         unsigned int sample_rate = 0;
 	double tau = 50e-6;
         std::string data_format = "f32";
         std::string signal_type = "scalar";
+        int block_size = 0;
         const char* input_capture_file = "-";
         const char* output_capture_file = "-";
         for ( int i = 1; i < argc; i += 2 ) {
@@ -99,6 +60,8 @@ int main(int argc, char** argv)
                         tau = atof( argv[i+1] );
                 } else if ( arg == "-t" ) {
                         signal_type = argv[i+1];
+                } else if ( arg == "-b" ) {
+                        block_size = atoi( argv[i+1] );
                 } else if ( arg == "-d" ) {
                         data_format = argv[i+1];
                 } else if ( arg == "-i" ) {
@@ -111,9 +74,14 @@ int main(int argc, char** argv)
                 std::cerr << prog_name << " : ERROR: please set a valid sample rate !\n";
                 return 1;
         }
+	if ( data_format == "cu8" ) {
+		data_format = "u8";
+	}
         if ( data_format != "i8" &&
+	     data_format != "u8" &&
              data_format != "i16" &&
              data_format != "i32" &&
+	     data_format != "f16" &&
              data_format != "f32" &&
              data_format != "f64" ) {
                 std::cerr << prog_name << " : ERROR: please set a valid data format !\n";
@@ -127,9 +95,16 @@ int main(int argc, char** argv)
                 std::cerr << prog_name << " : ERROR: please set a valid signal type !\n";
                 return 1;
         }
+        if ( block_size < 0 ) {
+                std::cerr << prog_name << " : ERROR: please set a valid block size !\n";
+                return 1;
+        }
+        if ( block_size == 0 ) {
+                block_size = sample_rate;
+        }
         FILE* fd_input = stdin;
         if ( input_capture_file != std::string("-") ) {
-                fd_input = fopen( input_capture_file, "rb" );
+                fd_input = capture_open( input_capture_file, "rb", data_format );
                 if ( fd_input == NULL ) {
 			std::cerr << prog_name << " : ";
                         perror("fopen()");
@@ -138,29 +113,30 @@ int main(int argc, char** argv)
         }
         FILE* fd_output = stdout;
         if ( output_capture_file != std::string("-") ) {
-                fd_output = fopen( output_capture_file, "w+b" );
+                fd_output = capture_open( output_capture_file, "w+b", data_format );
                 if ( fd_output == NULL ) {
 			std::cerr << prog_name << " : ";
                         perror("fopen()");
                         return 1;
                 }
         }
-	const double T = 1. / sample_rate;
-	const double tau_p = T / ( 2 * std::tan( T / ( 2 * tau ) ) );
-	const double a = T / (T + 2 * tau_p);
-	const double b = -(T - 2 * tau_p) / (T + 2 * tau_p);
+	const std::vector<biquad> sections = deemphasis_sections( sample_rate, tau );
         if ( signal_type == "scalar" ) {
-                if      ( data_format == "i8"  ) { deemphasis_scalar<char>( sample_rate, a, b, fd_input, fd_output); }
-                else if ( data_format == "i16" ) { deemphasis_scalar<short>( sample_rate, a, b, fd_input, fd_output); }
-                else if ( data_format == "i32" ) { deemphasis_scalar<int>( sample_rate, a, b, fd_input, fd_output); }
-                else if ( data_format == "f32" ) { deemphasis_scalar<float>( sample_rate, a, b, fd_input, fd_output); }
-                else if ( data_format == "f64" ) { deemphasis_scalar<double>( sample_rate, a, b, fd_input, fd_output); }
+                if      ( data_format == "i8"  ) { iir<char>( sections, 1, block_size, fd_input, fd_output); }
+                else if ( data_format == "u8"  ) { iir<u8_sample>( sections, 1, block_size, fd_input, fd_output); }
+                else if ( data_format == "i16" ) { iir<short>( sections, 1, block_size, fd_input, fd_output); }
+                else if ( data_format == "i32" ) { iir<int>( sections, 1, block_size, fd_input, fd_output); }
+                else if ( data_format == "f16" ) { iir<f16_sample>( sections, 1, block_size, fd_input, fd_output); }
+                else if ( data_format == "f32" ) { iir<float>( sections, 1, block_size, fd_input, fd_output); }
+                else if ( data_format == "f64" ) { iir<double>( sections, 1, block_size, fd_input, fd_output); }
         } else {
-                if      ( data_format == "i8"  ) { deemphasis_iq<char>( sample_rate, a, b, fd_input, fd_output); }
-                else if ( data_format == "i16" ) { deemphasis_iq<short>( sample_rate, a, b, fd_input, fd_output); }
-                else if ( data_format == "i32" ) { deemphasis_iq<int>( sample_rate, a, b, fd_input, fd_output); }
-                else if ( data_format == "f32" ) { deemphasis_iq<float>( sample_rate, a, b, fd_input, fd_output); }
-                else if ( data_format == "f64" ) { deemphasis_iq<double>( sample_rate, a, b, fd_input, fd_output); }
+                if      ( data_format == "i8"  ) { iir<char>( sections, 2, block_size, fd_input, fd_output); }
+                else if ( data_format == "u8"  ) { iir<u8_sample>( sections, 2, block_size, fd_input, fd_output); }
+                else if ( data_format == "i16" ) { iir<short>( sections, 2, block_size, fd_input, fd_output); }
+                else if ( data_format == "i32" ) { iir<int>( sections, 2, block_size, fd_input, fd_output); }
+                else if ( data_format == "f16" ) { iir<f16_sample>( sections, 2, block_size, fd_input, fd_output); }
+                else if ( data_format == "f32" ) { iir<float>( sections, 2, block_size, fd_input, fd_output); }
+                else if ( data_format == "f64" ) { iir<double>( sections, 2, block_size, fd_input, fd_output); }
         }
         return 0;
 }
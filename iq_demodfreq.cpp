@@ -23,39 +23,49 @@
 
 #include <iostream>
 #include <complex>
+#include "iq_u8.h"
+#include "iq_f16.h"
+#include "iq_capture.h"
+#include "iq_io.h"
+#include "iq_discriminator.h"
 
 static const unsigned int BUFFER_LEN = 200000;
 static const double PI = 4 * std::atan(1);
 
 template <class Input, class Output>
-void demodfreq_( const unsigned int sample_rate, FILE* fd_input, FILE* fd_output )
+void demodfreq_( const unsigned int sample_rate, const std::string& accuracy, FILE* fd_input, FILE* fd_output )
 {
-	Input* in_buff = new Input[ 2*BUFFER_LEN ];
+	Input* in_buff = new Input[ 2*BUFFER_LEN + 2 ]; /* the previous sample, then the block */
 	Output* out_buff = new Output[ BUFFER_LEN ];
-	std::complex<double> c_prev(0,0);
+	double* phase = new double[ BUFFER_LEN ];
+	discriminator discri( accuracy, BUFFER_LEN );
+	in_buff[ 0 ] = in_buff[ 1 ] = 0;
 	unsigned int nb_sample_read;
-	while( (nb_sample_read = fread( in_buff, 2*sizeof(*in_buff), BUFFER_LEN, fd_input)) > 0 ) {
+	while( (nb_sample_read = io_read( in_buff + 2, 2*sizeof(*in_buff), BUFFER_LEN, fd_input)) > 0 ) {
+		discri.process( in_buff + 2, nb_sample_read, phase );
 		for ( unsigned int i = 0; i < nb_sample_read; i++ ) {
-			std::complex<double> c( in_buff[2*i], in_buff[2*i+1] );
-		        double freq = std::arg( c * std::conj(c_prev) ) * sample_rate / (2 * PI);
-			out_buff[ i ] = freq;
-			c_prev = c;
+			out_buff[ i ] = phase[ i ] * sample_rate / (2 * PI);
 		}
-		fwrite( out_buff, sizeof(*out_buff), nb_sample_read, fd_output );
-                fflush( fd_output );
+		in_buff[ 0 ] = in_buff[ 2*nb_sample_read ];
+		in_buff[ 1 ] = in_buff[ 2*nb_sample_read+1 ];
+		io_write( out_buff, sizeof(*out_buff), nb_sample_read, fd_output );
+                io_flush( fd_output );
 	}
+	delete[] phase;
 	delete[] out_buff;
 	delete[] in_buff;
 }
 
 template <class T>
-void demodfreq( const unsigned int sample_rate, const std::string& output_data_format, FILE* fd_input, FILE* fd_output )
+void demodfreq( const unsigned int sample_rate, const std::string& accuracy, const std::string& output_data_format, FILE* fd_input, FILE* fd_output )
 {
-	if      ( output_data_format == "i8"  ) { demodfreq_<T,char>( sample_rate, fd_input, fd_output ); }
-	else if ( output_data_format == "i16" ) { demodfreq_<T,short>( sample_rate, fd_input, fd_output ); }
-	else if ( output_data_format == "i32" ) { demodfreq_<T,int>( sample_rate, fd_input, fd_output ); }
-	else if ( output_data_format == "f32" ) { demodfreq_<T,float>( sample_rate, fd_input, fd_output ); }
-	else if ( output_data_format == "f64" ) { demodfreq_<T,double>( sample_rate, fd_input, fd_output) ; }
+	if      ( output_data_format == "i8"  ) { demodfreq_<T,char>( sample_rate, accuracy, fd_input, fd_output ); }
+	else if ( output_data_format == "u8"  ) { demodfreq_<T,u8_sample>( sample_rate, accuracy, fd_input, fd_output ); }
+	else if ( output_data_format == "i16" ) { demodfreq_<T,short>( sample_rate, accuracy, fd_input, fd_output ); }
+	else if ( output_data_format == "i32" ) { demodfreq_<T,int>( sample_rate, accuracy, fd_input, fd_output ); }
+	else if ( output_data_format == "f16" ) { demodfreq_<T,f16_sample>( sample_rate, accuracy, fd_input, fd_output ); }
+	else if ( output_data_format == "f32" ) { demodfreq_<T,float>( sample_rate, accuracy, fd_input, fd_output ); }
+	else if ( output_data_format == "f64" ) { demodfreq_<T,double>( sample_rate, accuracy, fd_input, fd_output) ; }
 }
 
 int main(int argc, char** argv)
@@ -63,15 +73,20 @@ int main(int argc, char** argv)
 	if ( argc < 2 ) {
 		std::cerr << "Usage: " << argv[0] << " <OPTIONS>\n"
 			"  -s <SAMPLE_RATE>\n"
-			"  -d <INPUT_DATA_FORMAT> : i8 | i16 | i32 | f32 | f64 (default: i16)\n"
-			"  -D <OUTPUT_DATA_FORMAT> : i8 | i16 | i32 | f32 | f64 (default: f32)\n"
+			"  -d <INPUT_DATA_FORMAT> : i8 | u8 | i16 | i32 | f16 | f32 | f64 (default: i16)\n"
+			"  -D <OUTPUT_DATA_FORMAT> : i8 | u8 | i16 | i32 | f16 | f32 | f64 (default: f32)\n"
+			"  -a <ACCURACY> : fast (6.1e-4 rad) | accurate (2e-6 rad) | exact (default: exact)\n"
 			"  -i <INPUT_CAPTURE_FILE> (default: -)\n"
-			"  -o <OUTPUT_CAPTURE_FILE> (default: -)\n";
+			"  -o <OUTPUT_CAPTURE_FILE> (default: -)\n"
+			"  --stats-interval <SECONDS> : print the I/O and compute counters every SECONDS on stderr (default: on SIGUSR1 only)\n"
+			"  --stats-file <STATS_FILE> : rewrite the counters in STATS_FILE, every second by default\n";
 		return 1;
 	}
+	io_stats_start( argc, argv );
         unsigned int sample_rate = 0;
 	std::string data_format = "i16";
 	std::string output_data_format = "f32";
+	std::string accuracy = "exact";
 	const char* input_capture_file = "-";
 	const char* output_capture_file = "-";
 	for ( int i = 1; i < argc; i += 2 ) {
@@ -82,6 +97,8 @@ int main(int argc, char** argv)
 			data_format = argv[i+1];
 		} else if ( arg == "-D" ) {
 			output_data_format = argv[i+1];
+		} else if ( arg == "-a" ) {
+			accuracy = argv[i+1];
 		} else if ( arg == "-i" ) {
 			input_capture_file = argv[i+1];
 		} else if ( arg == "-o" ) {
@@ -92,25 +109,39 @@ int main(int argc, char** argv)
                 std::cerr << "ERROR: please set a valid sample rate !\n";
                 return 1;
         }
+	if ( data_format == "cu8" ) {
+		data_format = "u8";
+	}
 	if ( data_format != "i8" &&
+	     data_format != "u8" &&
 	     data_format != "i16" &&
 	     data_format != "i32" &&
+	     data_format != "f16" &&
 	     data_format != "f32" &&
 	     data_format != "f64" ) {
 		std::cerr << "ERROR: please set a valid data format !\n";
 		return 1;
 	}
+	if ( output_data_format == "cu8" ) {
+		output_data_format = "u8";
+	}
 	if ( output_data_format != "i8" &&
+	     output_data_format != "u8" &&
 	     output_data_format != "i16" &&
 	     output_data_format != "i32" &&
+	     output_data_format != "f16" &&
 	     output_data_format != "f32" &&
 	     output_data_format != "f64" ) {
 		std::cerr << "ERROR: please set a valid output data format !\n";
 		return 1;
 	}
+	if ( accuracy != "fast" && accuracy != "accurate" && accuracy != "exact" ) {
+		std::cerr << "ERROR: please set a valid accuracy !\n";
+		return 1;
+	}
         FILE* fd_input = stdin;
 	if ( input_capture_file != std::string("-") ) {
-		fd_input = fopen( input_capture_file, "rb" );
+		fd_input = capture_open( input_capture_file, "rb", data_format );
 		if ( fd_input == NULL ) {
 			perror("fopen()");
 			return 1;
@@ -118,16 +149,18 @@ int main(int argc, char** argv)
 	}
 	FILE* fd_output = stdout;
 	if ( output_capture_file != std::string("-") ) {
-		fd_output = fopen( output_capture_file, "w+b" );
+		fd_output = capture_open( output_capture_file, "w+b", output_data_format );
 		if ( fd_output == NULL ) {
 			perror("fopen()");
 			return 1;
 		}
 	}
-	if      ( data_format == "i8"  ) { demodfreq<char>( sample_rate, output_data_format, fd_input, fd_output); }
-	else if ( data_format == "i16" ) { demodfreq<short>( sample_rate, output_data_format, fd_input, fd_output); }
-	else if ( data_format == "i32" ) { demodfreq<int>( sample_rate, output_data_format, fd_input, fd_output); }
-	else if ( data_format == "f32" ) { demodfreq<float>( sample_rate, output_data_format, fd_input, fd_output); }
-	else if ( data_format == "f64" ) { demodfreq<double>( sample_rate, output_data_format, fd_input, fd_output); }
+	if      ( data_format == "i8"  ) { demodfreq<char>( sample_rate, accuracy, output_data_format, fd_input, fd_output); }
+	else if ( data_format == "u8"  ) { demodfreq<u8_sample>( sample_rate, accuracy, output_data_format, fd_input, fd_output); }
+	else if ( data_format == "i16" ) { demodfreq<short>( sample_rate, accuracy, output_data_format, fd_input, fd_output); }
+	else if ( data_format == "i32" ) { demodfreq<int>( sample_rate, accuracy, output_data_format, fd_input, fd_output); }
+	else if ( data_format == "f16" ) { demodfreq<f16_sample>( sample_rate, accuracy, output_data_format, fd_input, fd_output); }
+	else if ( data_format == "f32" ) { demodfreq<float>( sample_rate, accuracy, output_data_format, fd_input, fd_output); }
+	else if ( data_format == "f64" ) { demodfreq<double>( sample_rate, accuracy, output_data_format, fd_input, fd_output); }
 	return 0;
 }
@@ -0,0 +1,214 @@
+/*
+  ===========================================================================
+
+  Copyright (C) 2018 Emvivre
+
+  This file is part of IQ_TOOLBOX.
+
+  IQ_TOOLBOX is free software: you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation, either version 3 of the License, or
+  (at your option) any later version.
+
+  IQ_TOOLBOX is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with IQ_TOOLBOX.  If not, see <http://www.gnu.org/licenses/>.
+
+  ===========================================================================
+*/
+
+#ifndef IQ_DISCRIMINATOR_H
+#define IQ_DISCRIMINATOR_H
+
+#include <cmath>
+#include <complex>
+#include <string>
+#include <vector>
+#include <algorithm>
+#include <limits>
+#include <cstring>
+#include "iq_fir.h"
+#include "iq_u8.h"
+
+/*
+  Phase difference between consecutive I/Q samples, arg( c[i] * conj( c[i-1] ) ).
+  Besides the exact libm atan2 in double, atan2 is approximated in float by
+  an odd minimax polynomial of atan on [0,1] followed by a branch free
+  octant reduction, on whole vectors. Maximum error of the
+  accuracy tiers, in radians:
+    fast     : 3 terms, 6.1e-4
+    accurate : 6 terms, 2e-6 (1.7e-6 from the polynomial, the rest from the float rounding)
+    exact    : std::arg in double
+*/
+static const float ATAN_FAST_COEF[ 3 ] = { 0.99535792f, -0.28869003f, 0.079338827f };
+static const float ATAN_ACCURATE_COEF[ 6 ] = { 0.99997722f, -0.33262282f, 0.19354035f, -0.11642640f, 0.052647263f, -0.011719100f };
+
+#if defined(__AVX__)
+static const int ATAN_WIDTH = SIMD_WIDTH;
+#else
+static const int ATAN_WIDTH = 16; /* without AVX, the selects of wider vectors are split into scalar code */
+#endif
+typedef float atan_vec __attribute__(( vector_size( ATAN_WIDTH ) ));
+static const int ATAN_NB_LANE = ATAN_WIDTH / sizeof(float);
+
+template <int NB_TERM>
+inline void atan2_poly( const atan_vec& y, const atan_vec& x, const float* coef, atan_vec& r )
+{
+	const atan_vec zero = atan_vec();
+	const atan_vec ax = ( x < zero ) ? -x : x;
+	const atan_vec ay = ( y < zero ) ? -y : y;
+	const atan_vec mx = ( ax > ay ) ? ax : ay;
+	const atan_vec mn = ( ax > ay ) ? ay : ax;
+	const atan_vec tiny = zero + std::numeric_limits<float>::min();
+	const atan_vec z = mn / ( ( mx > tiny ) ? mx : tiny );
+	const atan_vec z2 = z * z;
+	atan_vec p = zero + coef[ NB_TERM - 1 ];
+	for ( int k = NB_TERM - 2; k >= 0; k-- ) {
+		p = p * z2 + coef[ k ];
+	}
+	const atan_vec r0 = p * z;
+	const atan_vec r1 = ( ay > ax ) ? float( M_PI / 2 ) - r0 : r0;
+	const atan_vec r2 = ( x < zero ) ? float( M_PI ) - r1 : r1;
+	r = ( y < zero ) ? -r2 : r2;
+}
+
+/*
+  The approximated tiers first compute c[i] * conj( c[i-1] ) of the whole
+  block into float planes, then run the polynomial over whole vectors, the
+  plane being padded to a multiple of ATAN_NB_LANE. The product of
+  floating point samples is computed in double and scaled to a unit
+  magnitude before being rounded to float, so that small f32 or f64
+  samples neither underflow nor lose their bits; the product of integer
+  samples fits in float as is.
+*/
+template <class Input> struct discriminator_scaled { static const bool value = false; };
+template <> struct discriminator_scaled<float> { static const bool value = true; };
+template <> struct discriminator_scaled<double> { static const bool value = true; };
+
+class discriminator
+{
+public:
+	discriminator( const std::string& accuracy, unsigned int block_size )
+		: accuracy( accuracy ), re( block_size + ATAN_NB_LANE ), im( block_size + ATAN_NB_LANE )
+	{
+	}
+
+	/*
+	  out[i] = arg( c[i] * conj( c[i-1] ) ) for the n <= block_size
+	  interleaved I/Q samples of in, in[-2] and in[-1] holding the previous
+	  sample.
+	*/
+	template <class Input>
+	void process( const Input* in, const unsigned int n, double* out )
+	{
+		if ( accuracy == "fast" ) {
+			process_poly<Input, 3>( in, n, ATAN_FAST_COEF, out );
+		} else if ( accuracy == "accurate" ) {
+			process_poly<Input, 6>( in, n, ATAN_ACCURATE_COEF, out );
+		} else {
+			const Input* prev = in - 2;
+			for ( unsigned int i = 0; i < n; i++ ) {
+				const std::complex<double> c( in[ 2*i ], in[ 2*i+1 ] );
+				const std::complex<double> c_prev( prev[ 2*i ], prev[ 2*i+1 ] );
+				out[ i ] = std::arg( c * std::conj( c_prev ) );
+			}
+		}
+	}
+
+	/*
+	  8 bit samples: the phase of every I/Q byte pair is looked up in a 64K
+	  entries table, and the difference is wrapped to ] -pi, pi ], whatever
+	  the accuracy. It differs from std::arg in the last bits of the double
+	  at most, except on the real axis where the wrapping and the signed
+	  zeros decide: there, when a sample is zero or both are on a same line
+	  through the origin, std::arg itself is called.
+	*/
+	void process( const char* in, const unsigned int n, double* out )
+	{
+		process_table( reinterpret_cast<const unsigned char*>( in ), n, false, out );
+	}
+
+	void process( const u8_sample* in, const unsigned int n, double* out )
+	{
+		process_table( reinterpret_cast<const unsigned char*>( in ), n, true, out );
+	}
+
+private:
+	void process_table( const unsigned char* in, const unsigned int n, const bool offset_binary, double* out )
+	{
+		if ( phase_table.empty() ) {
+			phase_table.resize( 1 << 16 );
+			for ( unsigned int k = 0; k < phase_table.size(); k++ ) {
+				const int i = offset_binary ? int( k & 0xff ) - 128 : (signed char)( k & 0xff );
+				const int q = offset_binary ? int( k >> 8 ) - 128 : (signed char)( k >> 8 );
+				phase_table[ k ] = std::atan2( double(q), double(i) );
+			}
+		}
+		const unsigned int flip = offset_binary ? 0 : 0x80; /* to offset binary */
+		const double* table = &phase_table[0];
+		const unsigned char* prev = in - 2;
+		for ( size_t i = 0; i < n; i++ ) {
+			const unsigned int k = in[ 2*i ] | ( in[ 2*i+1 ] << 8 );
+			const unsigned int k_prev = prev[ 2*i ] | ( prev[ 2*i+1 ] << 8 );
+			const int xr = int( in[ 2*i ] ^ flip ) - 128, xi = int( in[ 2*i+1 ] ^ flip ) - 128;
+			const int pr = int( prev[ 2*i ] ^ flip ) - 128, pi = int( prev[ 2*i+1 ] ^ flip ) - 128;
+			if ( xi * pr - xr * pi == 0 ) {
+				/* on the real axis, ±pi or a signed zero */
+				out[ i ] = std::arg( std::complex<double>( xr, xi ) * std::conj( std::complex<double>( pr, pi ) ) );
+				continue;
+			}
+			const double d = table[ k ] - table[ k_prev ];
+			out[ i ] = ( d > M_PI ) ? d - 2 * M_PI : ( d <= -M_PI ) ? d + 2 * M_PI : d;
+		}
+	}
+
+	template <class Input, int NB_TERM>
+	void process_poly( const Input* in, const unsigned int n, const float* coef, double* out )
+	{
+		const Input* prev = in - 2;
+		float* x = &re[0];
+		float* y = &im[0];
+		if ( discriminator_scaled<Input>::value ) {
+			for ( size_t i = 0; i < n; i++ ) {
+				const double xr = in[ 2*i ], xi = in[ 2*i+1 ];
+				const double pr = prev[ 2*i ], pi = prev[ 2*i+1 ];
+				const double dx = xr * pr + xi * pi;
+				const double dy = xi * pr - xr * pi;
+				const double m = std::max( std::fabs( dx ), std::fabs( dy ) );
+				const double s = ( m > 0 ) ? 1 / m : 0;
+				x[ i ] = dx * s;
+				y[ i ] = dy * s;
+			}
+		} else {
+			for ( size_t i = 0; i < n; i++ ) {
+				const float xr = in[ 2*i ], xi = in[ 2*i+1 ];
+				const float pr = prev[ 2*i ], pi = prev[ 2*i+1 ];
+				x[ i ] = xr * pr + xi * pi;
+				y[ i ] = xi * pr - xr * pi;
+			}
+		}
+		std::fill( x + n, x + n + ATAN_NB_LANE, 0.f );
+		std::fill( y + n, y + n + ATAN_NB_LANE, 0.f );
+		for ( size_t i = 0; i < n; i += ATAN_NB_LANE ) {
+			atan_vec vx, vy, r;
+			memcpy( &vx, x + i, sizeof(vx) );
+			memcpy( &vy, y + i, sizeof(vy) );
+			atan2_poly<NB_TERM>( vy, vx, coef, r );
+			memcpy( x + i, &r, sizeof(r) );
+		}
+		for ( size_t i = 0; i < n; i++ ) {
+			out[ i ] = x[ i ];
+		}
+	}
+
+	std::string accuracy;
+	std::vector<float> re;
+	std::vector<float> im;
+	std::vector<double> phase_table; /* 8 bit samples, indexed by I | Q << 8 */
+};
+
+#endif
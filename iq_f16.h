@@ -0,0 +1,179 @@
+/*
+  ===========================================================================
+
+  Copyright (C) 2018 Emvivre
+
+  This file is part of IQ_TOOLBOX.
+
+  IQ_TOOLBOX is free software: you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation, either version 3 of the License, or
+  (at your option) any later version.
+
+  IQ_TOOLBOX is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with IQ_TOOLBOX.  If not, see <http://www.gnu.org/licenses/>.
+
+  ===========================================================================
+*/
+
+#ifndef IQ_F16_H
+#define IQ_F16_H
+
+#include <cstring>
+#include <limits>
+#include <stdint.h>
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#endif
+
+/* IEEE 754 binary16 from binary32, rounded to nearest even, overflowing to infinity */
+inline uint16_t float_to_half( float f )
+{
+	uint32_t x;
+	std::memcpy( &x, &f, sizeof(x) );
+	const uint16_t sign = ( x >> 16 ) & 0x8000;
+	x &= 0x7fffffff;
+	if ( x >= 0x7f800000 ) { /* infinity or NaN, kept quiet */
+		return sign | 0x7c00 | ( ( x > 0x7f800000 ) ? 0x200 : 0 );
+	}
+	if ( x >= 0x477ff000 ) { /* 65520 and above round to infinity */
+		return sign | 0x7c00;
+	}
+	if ( x < 0x38800000 ) { /* below 2^-14: subnormal, in units of 2^-24 */
+		if ( x < 0x33000000 ) {
+			return sign;
+		}
+		const uint32_t m = ( x & 0x7fffff ) | 0x800000;
+		const int shift = 126 - int( x >> 23 );
+		uint32_t r = m >> shift;
+		const uint32_t rem = m & ( ( 1u << shift ) - 1 );
+		const uint32_t half = 1u << ( shift - 1 );
+		if ( rem > half || ( rem == half && ( r & 1 ) ) ) {
+			r++;
+		}
+		return sign | r;
+	}
+	uint32_t r = x - 0x38000000; /* exponent rebiased from 127 to 15 */
+	r += 0xfff + ( ( r >> 13 ) & 1 );
+	return sign | ( r >> 13 );
+}
+
+inline float half_to_float( uint16_t h )
+{
+	const uint32_t sign = uint32_t( h & 0x8000 ) << 16;
+	const uint32_t e = ( h >> 10 ) & 0x1f;
+	const uint32_t m = h & 0x3ff;
+	if ( e == 0 ) {
+		const float v = m * ( 1.f / 16777216 );
+		return sign ? -v : v;
+	}
+	const uint32_t x = sign | ( ( e == 31 ) ? 0x7f800000 | ( m << 13 ) : ( ( e + 112 ) << 23 ) | ( m << 13 ) );
+	float f;
+	std::memcpy( &f, &x, sizeof(f) );
+	return f;
+}
+
+/*
+  IEEE half precision sample: it converts to and from the arithmetic types
+  like the other formats, halving the bytes of f32 for the 11 bits of
+  mantissa that most intermediate signals need.
+*/
+class f16_sample
+{
+public:
+	f16_sample() {}
+	explicit f16_sample( double x ) { *this = x; }
+
+	f16_sample& operator=( double x )
+	{
+		h = float_to_half( float( x ) );
+		return *this;
+	}
+
+	operator double() const { return half_to_float( h ); }
+
+	uint16_t bits() const { return h; }
+
+private:
+	uint16_t h;
+};
+
+namespace std {
+template <> class numeric_limits<f16_sample> : public numeric_limits<float>
+{
+public:
+	static const int digits = 11;
+	static f16_sample min() { return f16_sample( 6.103515625e-05 ); }
+	static f16_sample max() { return f16_sample( 65504 ); }
+	static f16_sample lowest() { return f16_sample( -65504 ); }
+};
+}
+
+/*
+  Block conversions, with the F16C instructions when the CPU has them
+  (checked at run time, the toolbox being built for the baseline target).
+*/
+#if defined(__x86_64__) || defined(__i386__)
+__attribute__(( target( "avx,f16c" ) ))
+inline void f16_decode_f16c( const f16_sample* in, unsigned int n, float* out )
+{
+	unsigned int i = 0;
+	for ( ; i + 8 <= n; i += 8 ) {
+		_mm256_storeu_ps( out + i, _mm256_cvtph_ps( _mm_loadu_si128( (const __m128i*) ( in + i ) ) ) );
+	}
+	for ( ; i < n; i++ ) {
+		out[ i ] = half_to_float( in[ i ].bits() );
+	}
+}
+
+__attribute__(( target( "avx,f16c" ) ))
+inline void f16_encode_f16c( const float* in, unsigned int n, f16_sample* out )
+{
+	unsigned int i = 0;
+	for ( ; i + 8 <= n; i += 8 ) {
+		_mm_storeu_si128( (__m128i*) ( out + i ), _mm256_cvtps_ph( _mm256_loadu_ps( in + i ), _MM_FROUND_TO_NEAREST_INT ) );
+	}
+	for ( ; i < n; i++ ) {
+		out[ i ] = in[ i ];
+	}
+}
+
+inline bool has_f16c()
+{
+	static const bool r = __builtin_cpu_supports( "f16c" ) && __builtin_cpu_supports( "avx" );
+	return r;
+}
+#endif
+
+inline void f16_decode( const f16_sample* in, unsigned int n, float* out )
+{
+#if defined(__x86_64__) || defined(__i386__)
+	if ( has_f16c() ) {
+		f16_decode_f16c( in, n, out );
+		return;
+	}
+#endif
+	for ( unsigned int i = 0; i < n; i++ ) {
+		out[ i ] = half_to_float( in[ i ].bits() );
+	}
+}
+
+inline void f16_encode( const float* in, unsigned int n, f16_sample* out )
+{
+#if defined(__x86_64__) || defined(__i386__)
+	if ( has_f16c() ) {
+		f16_encode_f16c( in, n, out );
+		return;
+	}
+#endif
+	for ( unsigned int i = 0; i < n; i++ ) {
+		out[ i ] = in[ i ];
+	}
+}
+
+#endif
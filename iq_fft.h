@@ -0,0 +1,217 @@
+/*
+  ===========================================================================
+
+  Copyright (C) 2018 Emvivre
+
+  This file is part of IQ_TOOLBOX.
+
+  IQ_TOOLBOX is free software: you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation, either version 3 of the License, or
+  (at your option) any later version.
+
+  IQ_TOOLBOX is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with IQ_TOOLBOX.  If not, see <http://www.gnu.org/licenses/>.
+
+  ===========================================================================
+*/
+
+#ifndef IQ_FFT_H
+#define IQ_FFT_H
+
+#include <cmath>
+#include <complex>
+#include <vector>
+
+/*
+  In place iterative radix-2 complex FFT, size a power of two. The
+  butterflies are written on the real and imaginary parts so that no
+  __muldc3 call is emitted for the complex products.
+*/
+class fft
+{
+public:
+	explicit fft( unsigned int size )
+		: size( size ), twiddle( size / 2 ), bitrev( size )
+	{
+		const double pi = 4 * std::atan(1);
+		for ( unsigned int k = 0; k < size / 2; k++ ) {
+			twiddle[ k ] = std::polar( 1., -2 * pi * k / size );
+		}
+		unsigned int nb_bit = 0;
+		while ( ( 1u << nb_bit ) < size ) {
+			nb_bit++;
+		}
+		for ( unsigned int i = 0; i < size; i++ ) {
+			unsigned int r = 0;
+			for ( unsigned int b = 0; b < nb_bit; b++ ) {
+				r |= ( ( i >> b ) & 1 ) << ( nb_bit - 1 - b );
+			}
+			bitrev[ i ] = r;
+		}
+	}
+
+	/* inverse transform is not scaled by 1 / size */
+	void transform( std::complex<double>* x, bool inverse ) const
+	{
+		for ( unsigned int i = 0; i < size; i++ ) {
+			if ( i < bitrev[ i ] ) {
+				std::swap( x[ i ], x[ bitrev[ i ] ] );
+			}
+		}
+		double* v = reinterpret_cast<double*>( x );
+		const double* w = reinterpret_cast<const double*>( &twiddle[0] );
+		const double sign = inverse ? -1 : 1;
+		for ( unsigned int half = 1; half < size; half *= 2 ) {
+			const unsigned int stride = size / ( 2 * half );
+			for ( unsigned int start = 0; start < size; start += 2 * half ) {
+				for ( unsigned int k = 0; k < half; k++ ) {
+					const double wr = w[ 2 * k * stride ];
+					const double wi = sign * w[ 2 * k * stride + 1 ];
+					double* a = v + 2 * ( start + k );
+					double* b = a + 2 * half;
+					const double tr = b[0] * wr - b[1] * wi;
+					const double ti = b[0] * wi + b[1] * wr;
+					b[0] = a[0] - tr;
+					b[1] = a[1] - ti;
+					a[0] += tr;
+					a[1] += ti;
+				}
+			}
+		}
+	}
+
+private:
+	unsigned int size;
+	std::vector< std::complex<double> > twiddle;
+	std::vector<unsigned int> bitrev;
+};
+
+/*
+  Overlap-save fast convolution computing, like the direct form of the
+  toolbox, z[t] = sum_k coef[k] * w[t+k]. Every FFT of fft_size samples
+  gives fft_size - nb_coef + 1 outputs. Scalar signals are filtered two
+  segments at a time, one in the real part and one in the imaginary part,
+  as the coefficients are real.
+*/
+template <class S>
+class fft_filter
+{
+public:
+	fft_filter( const double* coef, unsigned int nb_coef )
+		: nb_coef( nb_coef ), fft_size( fft_size_for( nb_coef ) ), step( fft_size - nb_coef + 1 ),
+		  engine( fft_size ), response( fft_size ), seg( fft_size )
+	{
+		for ( unsigned int m = 0; m < nb_coef; m++ ) {
+			response[ m ] = coef[ nb_coef - 1 - m ] / fft_size;
+		}
+		engine.transform( &response[0], false );
+	}
+
+	static unsigned int fft_size_for( unsigned int nb_coef )
+	{
+		unsigned int n = 256;
+		while ( n < 4 * nb_coef ) {
+			n *= 2;
+		}
+		return n;
+	}
+
+	/*
+	  Estimated cost, in real multiply-accumulates, of one input sample: a
+	  radix-2 butterfly costs about a complex multiply-accumulate, i.e. 4
+	  real ones, and there are 2 transforms of log2(n) * n / 2 butterflies.
+	*/
+	static double cost_per_sample( unsigned int nb_coef, int nb_chan )
+	{
+		const double n = fft_size_for( nb_coef );
+		const double fft_cost = 4 * ( n * std::log2( n ) + n );
+		return fft_cost / ( n - nb_coef + 1 ) / ( nb_chan == 1 ? 2 : 1 );
+	}
+
+	/*
+	  out[j] = z[j * dec_rate] for j * dec_rate < n. w must hold
+	  n + 2 * fft_size samples, those past n + nb_coef - 1 being read but
+	  not used.
+	*/
+	unsigned int process( const S* w, unsigned int n, unsigned int dec_rate, S* out )
+	{
+		unsigned int j = 0;
+		const unsigned int nb_lane = is_scalar() ? 2 : 1;
+		for ( unsigned int s = 0; s < n; s += nb_lane * step ) {
+			for ( unsigned int i = 0; i < fft_size; i++ ) {
+				seg[ i ] = load( w + s, i );
+			}
+			engine.transform( &seg[0], false );
+			for ( unsigned int i = 0; i < fft_size; i++ ) {
+				const double ar = seg[ i ].real(), ai = seg[ i ].imag();
+				const double br = response[ i ].real(), bi = response[ i ].imag();
+				seg[ i ] = std::complex<double>( ar * br - ai * bi, ar * bi + ai * br );
+			}
+			engine.transform( &seg[0], true );
+			for ( unsigned int lane = 0; lane < nb_lane; lane++ ) {
+				const unsigned int base = s + lane * step;
+				unsigned int t = ( base + dec_rate - 1 ) / dec_rate * dec_rate;
+				for ( ; t < base + step && t < n; t += dec_rate ) {
+					out[ j++ ] = store( seg[ t - base + nb_coef - 1 ], lane );
+				}
+			}
+		}
+		return j;
+	}
+
+private:
+	static bool is_scalar();
+	std::complex<double> load( const S* w, unsigned int i ) const;
+	static S store( const std::complex<double>& c, unsigned int lane );
+
+	unsigned int nb_coef;
+	unsigned int fft_size;
+	unsigned int step;
+	fft engine;
+	std::vector< std::complex<double> > response;
+	std::vector< std::complex<double> > seg;
+};
+
+template <> inline bool fft_filter<double>::is_scalar() { return true; }
+template <> inline bool fft_filter< std::complex<double> >::is_scalar() { return false; }
+
+template <> inline std::complex<double> fft_filter<double>::load( const double* w, unsigned int i ) const
+{
+	return std::complex<double>( w[ i ], w[ step + i ] );
+}
+
+template <> inline std::complex<double> fft_filter< std::complex<double> >::load( const std::complex<double>* w, unsigned int i ) const
+{
+	return w[ i ];
+}
+
+template <> inline double fft_filter<double>::store( const std::complex<double>& c, unsigned int lane )
+{
+	return lane == 0 ? c.real() : c.imag();
+}
+
+template <> inline std::complex<double> fft_filter< std::complex<double> >::store( const std::complex<double>& c, unsigned int )
+{
+	return c;
+}
+
+/*
+  The direct form only computes the output samples, with SIMD_WIDTH bytes
+  vectors, so its multiply-accumulates are weighted by DIRECT_MAC_WEIGHT
+  before being compared to the overlap-save ones.
+*/
+static const double DIRECT_MAC_WEIGHT = 0.35;
+
+inline bool fft_is_faster( const int nb_coef, const int nb_chan, const int dec_rate )
+{
+	const double direct_cost = DIRECT_MAC_WEIGHT * nb_coef * nb_chan / dec_rate;
+	return fft_filter<double>::cost_per_sample( nb_coef, nb_chan ) < direct_cost;
+}
+
+#endif
@@ -0,0 +1,230 @@
+/*
+  ===========================================================================
+
+  Copyright (C) 2018 Emvivre
+
+  This file is part of IQ_FILTER.
+
+  IQ_FILTER is free software: you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation, either version 3 of the License, or
+  (at your option) any later version.
+
+  IQ_FILTER is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with IQ_FILTER.  If not, see <http://www.gnu.org/licenses/>.
+
+  ===========================================================================
+*/
+
+#include <iostream>
+#include <complex>
+#include <vector>
+#include <algorithm>
+#include "iq_u8.h"
+#include "iq_f16.h"
+#include "iq_capture.h"
+#include "iq_io.h"
+#include "fir.h"
+#include "iq_fir.h"
+#include "iq_fft.h"
+
+static const unsigned int BUFFER_LEN = 200000;
+
+/*
+  Both engines compute y[n] = sum_k coef[k] * x[n - nb_coef + 1 + k] on a
+  buffer holding the nb_coef - 1 previous samples followed by the block.
+*/
+template <class T>
+void filter_direct( const int nb_chan, const double* coef, const int nb_coef, FILE* fd_input, FILE* fd_output )
+{
+	simd_fir<double> fir( coef, nb_coef, nb_chan );
+	const unsigned int hist_len = nb_chan * ( nb_coef - 1 );
+	const unsigned int work_len = hist_len + nb_chan * BUFFER_LEN + fir.span();
+	T* in_buff = new T[ nb_chan * BUFFER_LEN ];
+	T* out_buff = new T[ nb_chan * BUFFER_LEN ];
+	double* work = (double*) aligned_alloc( SIMD_WIDTH, ( work_len * sizeof(double) + SIMD_WIDTH - 1 ) / SIMD_WIDTH * SIMD_WIDTH );
+	std::fill( work, work + work_len, 0. );
+	double y[ 2 ] = { 0, 0 };
+	unsigned int nb_sample_read;
+	while( (nb_sample_read = io_read( in_buff, nb_chan*sizeof(*in_buff), BUFFER_LEN, fd_input)) > 0 ) {
+		double* x = work + hist_len;
+		for ( unsigned int i = 0; i < nb_chan * nb_sample_read; i++ ) {
+			x[ i ] = in_buff[ i ];
+		}
+		for ( unsigned int i = 0; i < nb_sample_read; i++ ) {
+			fir.dot( work + nb_chan * i, y );
+			for ( int c = 0; c < nb_chan; c++ ) {
+				out_buff[ nb_chan*i + c ] = y[ c ];
+			}
+		}
+		std::copy( work + nb_chan * nb_sample_read, work + nb_chan * nb_sample_read + hist_len, work );
+		io_write( out_buff, nb_chan*sizeof(*out_buff), nb_sample_read, fd_output );
+		io_flush( fd_output );
+	}
+	free( work );
+	delete[] out_buff;
+	delete[] in_buff;
+}
+
+template <class T, class S>
+void filter_fft( const int nb_chan, const double* coef, const int nb_coef, FILE* fd_input, FILE* fd_output )
+{
+	fft_filter<S> filter( coef, nb_coef );
+	const unsigned int hist_len = nb_coef - 1;
+	const unsigned int work_len = hist_len + BUFFER_LEN + 2 * fft_filter<S>::fft_size_for( nb_coef );
+	T* in_buff = new T[ nb_chan * BUFFER_LEN ];
+	T* out_buff = new T[ nb_chan * BUFFER_LEN ];
+	S* work = new S[ work_len ];
+	S* y = new S[ BUFFER_LEN ];
+	std::fill( work, work + work_len, S(0) );
+	double* x = reinterpret_cast<double*>( work + hist_len );
+	const double* v = reinterpret_cast<const double*>( y );
+	unsigned int nb_sample_read;
+	while( (nb_sample_read = io_read( in_buff, nb_chan*sizeof(*in_buff), BUFFER_LEN, fd_input)) > 0 ) {
+		for ( unsigned int i = 0; i < nb_chan * nb_sample_read; i++ ) {
+			x[ i ] = in_buff[ i ];
+		}
+		filter.process( work, nb_sample_read, 1, y );
+		for ( unsigned int i = 0; i < nb_chan * nb_sample_read; i++ ) {
+			out_buff[ i ] = v[ i ];
+		}
+		std::copy( work + nb_sample_read, work + nb_sample_read + hist_len, work );
+		io_write( out_buff, nb_chan*sizeof(*out_buff), nb_sample_read, fd_output );
+		io_flush( fd_output );
+	}
+	delete[] y;
+	delete[] work;
+	delete[] out_buff;
+	delete[] in_buff;
+}
+
+template <class T>
+void filter( const std::string& filter_engine, const std::string& signal_type, const int nb_coef, const unsigned int sample_rate, const unsigned int cutoff_frequency, FILE* fd_input, FILE* fd_output )
+{
+	const int nb_chan = ( signal_type == "scalar" ) ? 1 : 2;
+	std::vector<double> coef( nb_coef );
+	fir_gen( BLACKMAN_WINDOW_TYPE, nb_coef, sample_rate, cutoff_frequency, &coef[0], NULL, NULL );
+	if ( filter_engine == "fft" || ( filter_engine == "auto" && fft_is_faster( nb_coef, nb_chan, 1 ) ) ) {
+		std::cerr << "engine: fft\n";
+		if ( nb_chan == 1 ) {
+			filter_fft< T, double >( nb_chan, &coef[0], nb_coef, fd_input, fd_output );
+		} else {
+			filter_fft< T, std::complex<double> >( nb_chan, &coef[0], nb_coef, fd_input, fd_output );
+		}
+	} else {
+		std::cerr << "engine: direct\n";
+		filter_direct<T>( nb_chan, &coef[0], nb_coef, fd_input, fd_output );
+	}
+}
+
+int main(int argc, char** argv)
+{
+	if ( argc < 2 ) {
+		std::cerr << "Usage: " << argv[0] << " <OPTIONS>\n"
+			"  -s <SAMPLE_RATE>\n"
+			"  -f <CUTOFF_FREQUENCY>\n"
+			"  -n <NB_COEF> (default: 64)\n"
+			"  -e <FILTER_ENGINE> : auto | direct | fft (default: auto)\n"
+			"  -t <SIGNAL_TYPE> : scalar | iq (default: iq)\n"
+			"  -d <DATA_FORMAT> : i8 | u8 | i16 | i32 | f16 | f32 | f64 (default: i16)\n"
+			"  -i <INPUT_CAPTURE_FILE> (default: -)\n"
+			"  -o <OUTPUT_CAPTURE_FILE> (default: -)\n"
+			"  --stats-interval <SECONDS> : print the I/O and compute counters every SECONDS on stderr (default: on SIGUSR1 only)\n"
+			"  --stats-file <STATS_FILE> : rewrite the counters in STATS_FILE, every second by default\n";
+		return 1;
+	}
+	io_stats_start( argc, argv );
+	const std::string prog_name = argv[0];
+	unsigned int sample_rate = 0;
+	unsigned int cutoff_frequency = 0;
+	int nb_coef = 64;
+	std::string filter_engine = "auto";
+	std::string data_format = "i16";
+	std::string signal_type = "iq";
+	const char* input_capture_file = "-";
+	const char* output_capture_file = "-";
+	for ( int i = 1; i < argc; i += 2 ) {
+		std::string arg = argv[i];
+		if ( arg == "-s" ) {
+			sample_rate = atof( argv[i+1] );
+		} else if ( arg == "-f" ) {
+			cutoff_frequency = atof( argv[i+1] );
+		} else if ( arg == "-n" ) {
+			nb_coef = atoi( argv[i+1] );
+		} else if ( arg == "-e" ) {
+			filter_engine = argv[i+1];
+		} else if ( arg == "-t" ) {
+			signal_type = argv[i+1];
+		} else if ( arg == "-d" ) {
+			data_format = argv[i+1];
+		} else if ( arg == "-i" ) {
+			input_capture_file = argv[i+1];
+		} else if ( arg == "-o" ) {
+			output_capture_file = argv[i+1];
+		}
+	}
+	if ( sample_rate == 0 ) {
+		std::cerr << prog_name << " : ERROR: please set a valid sample rate !\n";
+		return 1;
+	}
+	if ( cutoff_frequency == 0 ) {
+		std::cerr << prog_name << " : ERROR: please set a valid cutoff frequency !\n";
+		return 1;
+	}
+	if ( nb_coef <= 0 ) {
+		std::cerr << prog_name << " : ERROR: please set a valid number of coefficients !\n";
+		return 1;
+	}
+	if ( filter_engine != "auto" && filter_engine != "direct" && filter_engine != "fft" ) {
+		std::cerr << prog_name << " : ERROR: please set a valid filter engine !\n";
+		return 1;
+	}
+	if ( data_format == "cu8" ) {
+		data_format = "u8";
+	}
+	if ( data_format != "i8" &&
+	     data_format != "u8" &&
+	     data_format != "i16" &&
+	     data_format != "i32" &&
+	     data_format != "f16" &&
+	     data_format != "f32" &&
+	     data_format != "f64" ) {
+		std::cerr << prog_name << " : ERROR: please set a valid data format !\n";
+		return 1;
+	}
+	if ( signal_type != "scalar" && signal_type != "iq" ) {
+		std::cerr << prog_name << " : ERROR: please set a valid signal type !\n";
+		return 1;
+	}
+	FILE* fd_input = stdin;
+	if ( input_capture_file != std::string("-") ) {
+		fd_input = capture_open( input_capture_file, "rb", data_format );
+		if ( fd_input == NULL ) {
+			std::cerr << prog_name << " : ";
+			perror("fopen()");
+			return 1;
+		}
+	}
+	FILE* fd_output = stdout;
+	if ( output_capture_file != std::string("-") ) {
+		fd_output = capture_open( output_capture_file, "w+b", data_format );
+		if ( fd_output == NULL ) {
+			std::cerr << prog_name << " : ";
+			perror("fopen()");
+			return 1;
+		}
+	}
+	if      ( data_format == "i8"  ) { filter<char>( filter_engine, signal_type, nb_coef, sample_rate, cutoff_frequency, fd_input, fd_output); }
+	else if ( data_format == "u8"  ) { filter<u8_sample>( filter_engine, signal_type, nb_coef, sample_rate, cutoff_frequency, fd_input, fd_output); }
+	else if ( data_format == "i16" ) { filter<short>( filter_engine, signal_type, nb_coef, sample_rate, cutoff_frequency, fd_input, fd_output); }
+	else if ( data_format == "i32" ) { filter<int>( filter_engine, signal_type, nb_coef, sample_rate, cutoff_frequency, fd_input, fd_output); }
+	else if ( data_format == "f16" ) { filter<f16_sample>( filter_engine, signal_type, nb_coef, sample_rate, cutoff_frequency, fd_input, fd_output); }
+	else if ( data_format == "f32" ) { filter<float>( filter_engine, signal_type, nb_coef, sample_rate, cutoff_frequency, fd_input, fd_output); }
+	else if ( data_format == "f64" ) { filter<double>( filter_engine, signal_type, nb_coef, sample_rate, cutoff_frequency, fd_input, fd_output); }
+	return 0;
+}
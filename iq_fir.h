@@ -0,0 +1,100 @@
+/*
+  ===========================================================================
+
+  Copyright (C) 2018 Emvivre
+
+  This file is part of IQ_TOOLBOX.
+
+  IQ_TOOLBOX is free software: you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation, either version 3 of the License, or
+  (at your option) any later version.
+
+  IQ_TOOLBOX is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with IQ_TOOLBOX.  If not, see <http://www.gnu.org/licenses/>.
+
+  ===========================================================================
+*/
+
+#ifndef IQ_FIR_H
+#define IQ_FIR_H
+
+#include <cstdlib>
+#include <cstring>
+
+/*
+  Explicitly vectorized FIR: the coefficients are zero padded to whole
+  SIMD_WIDTH bytes vectors and, for I/Q, duplicated so that the interleaved
+  samples are loaded as they are, the even lanes accumulating I and the odd
+  lanes Q. A is the accumulation type (float or double).
+*/
+static const int SIMD_WIDTH = 32;
+
+template <class A>
+class simd_fir
+{
+public:
+	typedef A vec __attribute__(( vector_size( SIMD_WIDTH ) ));
+	static const int NB_LANE = SIMD_WIDTH / sizeof(A);
+
+	simd_fir( const double* coef, int nb_coef, int nb_chan )
+		: nb_chan( nb_chan ), nb_vec( ( nb_coef * nb_chan + 2*NB_LANE - 1 ) / (2*NB_LANE) * 2 )
+	{
+		vcoef = (vec*) aligned_alloc( SIMD_WIDTH, nb_vec * sizeof(vec) );
+		A* c = (A*) vcoef;
+		for ( int i = 0; i < nb_vec * NB_LANE; i++ ) {
+			c[ i ] = ( i < nb_coef * nb_chan ) ? coef[ i / nb_chan ] : 0;
+		}
+	}
+
+	~simd_fir()
+	{
+		free( vcoef );
+	}
+
+	/* number of elements read by dot() past x, to be allocated and zeroed */
+	int span() const
+	{
+		return nb_vec * NB_LANE;
+	}
+
+	/* y[0..nb_chan-1] = filter applied to the nb_chan (1 or 2) interleaved channels of x */
+	void dot( const A* x, A* y ) const
+	{
+		vec acc0 = vec() , acc1 = vec();
+		for ( int k = 0; k < nb_vec; k += 2 ) {
+			vec x0, x1;
+			memcpy( &x0, x + k * NB_LANE, sizeof(vec) );
+			memcpy( &x1, x + (k+1) * NB_LANE, sizeof(vec) );
+			acc0 += x0 * vcoef[ k ];
+			acc1 += x1 * vcoef[ k+1 ];
+		}
+		acc0 += acc1;
+		A even = 0, odd = 0;
+		for ( int l = 0; l < NB_LANE; l += 2 ) {
+			even += acc0[ l ];
+			odd += acc0[ l+1 ];
+		}
+		if ( nb_chan == 1 ) {
+			y[ 0 ] = even + odd;
+		} else {
+			y[ 0 ] = even;
+			y[ 1 ] = odd;
+		}
+	}
+
+private:
+	simd_fir( const simd_fir& );
+	simd_fir& operator=( const simd_fir& );
+
+	int nb_chan;
+	int nb_vec;
+	vec* vcoef;
+};
+
+#endif
@@ -0,0 +1,193 @@
+/*
+  ===========================================================================
+
+  Copyright (C) 2018 Emvivre
+
+  This file is part of IQ_IIR.
+
+  IQ_IIR is free software: you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation, either version 3 of the License, or
+  (at your option) any later version.
+
+  IQ_IIR is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with IQ_IIR.  If not, see <http://www.gnu.org/licenses/>.
+
+  ===========================================================================
+*/
+
+#include <iostream>
+#include <vector>
+#include <string>
+#include <cstdlib>
+#include <cstdio>
+#include "iq_u8.h"
+#include "iq_f16.h"
+#include "iq_capture.h"
+#include "iq_io.h"
+#include "iq_iir.h"
+
+static const unsigned int DEFAULT_BLOCK_SIZE = 65536;
+
+int main(int argc, char** argv)
+{
+	if ( argc < 2 ) {
+		std::cerr << "Usage: " << argv[0] << " <OPTIONS>\n"
+			"  -s <SAMPLE_RATE> : needed by the presets\n"
+			"  -p <PRESET> : none | lowpass | highpass | deemphasis | preemphasis (default: none)\n"
+			"  -f <CUTOFF_FREQUENCY> : lowpass and highpass Butterworth filters\n"
+			"  -n <ORDER> : lowpass and highpass Butterworth filters (default: 2)\n"
+			"  -r <RC_TIME_CONSTANT> : deemphasis and preemphasis (default: 50e-6)\n"
+			"  -F <FREQ_MAX_POWER> : preemphasis (default: 20e3)\n"
+			"  -c <B0,B1,B2,A0,A1,A2> : second order section appended to the cascade, can be repeated\n"
+			"  -t <SIGNAL_TYPE> : scalar | iq | <NB_CHANNEL> interleaved channels (default: iq)\n"
+			"  -b <BLOCK_SIZE> : samples per block, lower for less latency (default: SAMPLE_RATE or 65536)\n"
+			"  -d <DATA_FORMAT> : i8 | u8 | i16 | i32 | f16 | f32 | f64 (default: f32)\n"
+			"  -i <INPUT_CAPTURE_FILE> (default: -)\n"
+			"  -o <OUTPUT_CAPTURE_FILE> (default: -)\n"
+			"  --stats-interval <SECONDS> : print the I/O and compute counters every SECONDS on stderr (default: on SIGUSR1 only)\n"
+			"  --stats-file <STATS_FILE> : rewrite the counters in STATS_FILE, every second by default\n";
+		return 1;
+	}
+	io_stats_start( argc, argv );
+	const std::string prog_name = argv[0];
+	unsigned int sample_rate = 0;
+	std::string preset = "none";
+	double cutoff_frequency = 0;
+	int order = 2;
+	double tau = 50e-6;
+	double freq_max_power = 20e3;
+	std::vector<biquad> extra_sections;
+	std::string signal_type = "iq";
+	int block_size = 0;
+	std::string data_format = "f32";
+	const char* input_capture_file = "-";
+	const char* output_capture_file = "-";
+	for ( int i = 1; i < argc; i += 2 ) {
+		std::string arg = argv[i];
+		if ( arg == "-s" ) {
+			sample_rate = atof( argv[i+1] );
+		} else if ( arg == "-p" ) {
+			preset = argv[i+1];
+		} else if ( arg == "-f" ) {
+			cutoff_frequency = atof( argv[i+1] );
+		} else if ( arg == "-n" ) {
+			order = atoi( argv[i+1] );
+		} else if ( arg == "-r" ) {
+			tau = atof( argv[i+1] );
+		} else if ( arg == "-F" ) {
+			freq_max_power = atof( argv[i+1] );
+		} else if ( arg == "-c" ) {
+			double c[ 6 ];
+			if ( sscanf( argv[i+1], "%lf,%lf,%lf,%lf,%lf,%lf", &c[0], &c[1], &c[2], &c[3], &c[4], &c[5] ) != 6 || c[3] == 0 ) {
+				std::cerr << prog_name << " : ERROR: please set a valid second order section !\n";
+				return 1;
+			}
+			const biquad s = { c[0] / c[3], c[1] / c[3], c[2] / c[3], c[4] / c[3], c[5] / c[3] };
+			extra_sections.push_back( s );
+		} else if ( arg == "-t" ) {
+			signal_type = argv[i+1];
+		} else if ( arg == "-b" ) {
+			block_size = atoi( argv[i+1] );
+		} else if ( arg == "-d" ) {
+			data_format = argv[i+1];
+		} else if ( arg == "-i" ) {
+			input_capture_file = argv[i+1];
+		} else if ( arg == "-o" ) {
+			output_capture_file = argv[i+1];
+		}
+	}
+	if ( preset != "none" && preset != "lowpass" && preset != "highpass" && preset != "deemphasis" && preset != "preemphasis" ) {
+		std::cerr << prog_name << " : ERROR: please set a valid preset !\n";
+		return 1;
+	}
+	if ( preset != "none" && sample_rate == 0 ) {
+		std::cerr << prog_name << " : ERROR: please set a valid sample rate !\n";
+		return 1;
+	}
+	if ( ( preset == "lowpass" || preset == "highpass" ) && ( cutoff_frequency <= 0 || 2 * cutoff_frequency >= sample_rate ) ) {
+		std::cerr << prog_name << " : ERROR: please set a valid cutoff frequency !\n";
+		return 1;
+	}
+	if ( order <= 0 ) {
+		std::cerr << prog_name << " : ERROR: please set a valid order !\n";
+		return 1;
+	}
+	if ( tau <= 0 ) {
+		std::cerr << prog_name << " : ERROR: please set a valid rc time constant !\n";
+		return 1;
+	}
+	if ( freq_max_power <= 0 ) {
+		std::cerr << prog_name << " : ERROR: please set a valid frequency of maximum power !\n";
+		return 1;
+	}
+	std::vector<biquad> sections;
+	if      ( preset == "lowpass" ) { sections = butterworth_sections( true, order, sample_rate, cutoff_frequency ); }
+	else if ( preset == "highpass" ) { sections = butterworth_sections( false, order, sample_rate, cutoff_frequency ); }
+	else if ( preset == "deemphasis" ) { sections = deemphasis_sections( sample_rate, tau ); }
+	else if ( preset == "preemphasis" ) { sections = preemphasis_sections( sample_rate, tau, freq_max_power ); }
+	sections.insert( sections.end(), extra_sections.begin(), extra_sections.end() );
+	if ( sections.empty() ) {
+		std::cerr << prog_name << " : ERROR: please set a preset or second order sections !\n";
+		return 1;
+	}
+	int nb_chan = 0;
+	if      ( signal_type == "scalar" ) { nb_chan = 1; }
+	else if ( signal_type == "iq" ) { nb_chan = 2; }
+	else { nb_chan = atoi( signal_type.c_str() ); }
+	if ( nb_chan <= 0 ) {
+		std::cerr << prog_name << " : ERROR: please set a valid signal type !\n";
+		return 1;
+	}
+	if ( block_size < 0 ) {
+		std::cerr << prog_name << " : ERROR: please set a valid block size !\n";
+		return 1;
+	}
+	if ( block_size == 0 ) {
+		block_size = ( sample_rate > 0 ) ? sample_rate : DEFAULT_BLOCK_SIZE;
+	}
+	if ( data_format == "cu8" ) {
+		data_format = "u8";
+	}
+	if ( data_format != "i8" &&
+	     data_format != "u8" &&
+	     data_format != "i16" &&
+	     data_format != "i32" &&
+	     data_format != "f16" &&
+	     data_format != "f32" &&
+	     data_format != "f64" ) {
+		std::cerr << prog_name << " : ERROR: please set a valid data format !\n";
+		return 1;
+	}
+	FILE* fd_input = stdin;
+	if ( input_capture_file != std::string("-") ) {
+		fd_input = capture_open( input_capture_file, "rb", data_format );
+		if ( fd_input == NULL ) {
+			std::cerr << prog_name << " : ";
+			perror("fopen()");
+			return 1;
+		}
+	}
+	FILE* fd_output = stdout;
+	if ( output_capture_file != std::string("-") ) {
+		fd_output = capture_open( output_capture_file, "w+b", data_format );
+		if ( fd_output == NULL ) {
+			std::cerr << prog_name << " : ";
+			perror("fopen()");
+			return 1;
+		}
+	}
+	if      ( data_format == "i8"  ) { iir<char>( sections, nb_chan, block_size, fd_input, fd_output); }
+	else if ( data_format == "u8"  ) { iir<u8_sample>( sections, nb_chan, block_size, fd_input, fd_output); }
+	else if ( data_format == "i16" ) { iir<short>( sections, nb_chan, block_size, fd_input, fd_output); }
+	else if ( data_format == "i32" ) { iir<int>( sections, nb_chan, block_size, fd_input, fd_output); }
+	else if ( data_format == "f16" ) { iir<f16_sample>( sections, nb_chan, block_size, fd_input, fd_output); }
+	else if ( data_format == "f32" ) { iir<float>( sections, nb_chan, block_size, fd_input, fd_output); }
+	else if ( data_format == "f64" ) { iir<double>( sections, nb_chan, block_size, fd_input, fd_output); }
+	return 0;
+}
@@ -0,0 +1,192 @@
+/*
+  ===========================================================================
+
+  Copyright (C) 2018 Emvivre
+
+  This file is part of IQ_TOOLBOX.
+
+  IQ_TOOLBOX is free software: you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation, either version 3 of the License, or
+  (at your option) any later version.
+
+  IQ_TOOLBOX is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with IQ_TOOLBOX.  If not, see <http://www.gnu.org/licenses/>.
+
+  ===========================================================================
+*/
+
+#ifndef IQ_IIR_H
+#define IQ_IIR_H
+
+#include <cstdio>
+#include <cmath>
+#include <vector>
+#include "iq_io.h"
+
+/*
+  Second order section, a0 being normalized to 1:
+    H(z) = ( b0 + b1 z^-1 + b2 z^-2 ) / ( 1 + a1 z^-1 + a2 z^-2 )
+  A first order section has b2 = a2 = 0.
+*/
+struct biquad
+{
+	double b0, b1, b2, a1, a2;
+};
+
+/* the RC de-emphasis of time constant tau, bilinear transformed with prewarping */
+inline std::vector<biquad> deemphasis_sections( double sample_rate, double tau )
+{
+	const double T = 1. / sample_rate;
+	const double tau_p = T / ( 2 * std::tan( T / ( 2 * tau ) ) );
+	const double a = T / (T + 2 * tau_p);
+	const double b = -(T - 2 * tau_p) / (T + 2 * tau_p);
+	const biquad s = { a, a, 0, -b, 0 };
+	return std::vector<biquad>( 1, s );
+}
+
+/* the pre-emphasis of time constant tau, flattened above freq_max_power */
+inline std::vector<biquad> preemphasis_sections( double sample_rate, double tau, double freq_max_power )
+{
+	const double PI = 4 * std::atan(1);
+	const double T = 1. / sample_rate;
+	const double delta = 1 / ( 2 * PI * freq_max_power );
+	const double tau_p = T / ( 2 * std::tan( T / ( 2 * tau ) ) );
+	const double delta_p = T / ( 2 * std::tan( T / ( 2 * delta ) ) );
+	const double tau_p2 = tau_p * tau_p;
+	const double delta_p2 = delta_p * delta_p;
+	const double b_p = std::sqrt( - tau_p2 + std::sqrt(tau_p2*tau_p2 + 8*tau_p2*delta_p2) ) / 2;
+	const double a_p = std::sqrt( 2 * b_p * b_p + tau_p2 );
+	const double a0 = (2 * a_p + T) / (2 * b_p + T);
+	const double a1 = (T - 2 * a_p) / (2 * b_p + T);
+	const double b = (2 * b_p - T) / (2 * b_p + T);
+	const biquad s = { a0, a1, 0, -b, 0 };
+	return std::vector<biquad>( 1, s );
+}
+
+/* Butterworth low-pass or high-pass of the given order, one section per pair of poles */
+inline std::vector<biquad> butterworth_sections( bool lowpass, unsigned int order, double sample_rate, double cutoff_frequency )
+{
+	const double PI = 4 * std::atan(1);
+	const double w0 = 2 * PI * cutoff_frequency / sample_rate;
+	const double cos_w0 = std::cos( w0 );
+	std::vector<biquad> sections;
+	for ( unsigned int k = 0; k < order / 2; k++ ) {
+		const double q = 1 / ( 2 * std::sin( ( 2*k + 1 ) * PI / ( 2 * order ) ) );
+		const double alpha = std::sin( w0 ) / ( 2 * q );
+		const double a0 = 1 + alpha;
+		const double g = ( lowpass ? 1 - cos_w0 : 1 + cos_w0 ) / ( 2 * a0 );
+		const biquad s = { g, lowpass ? 2*g : -2*g, g, -2 * cos_w0 / a0, ( 1 - alpha ) / a0 };
+		sections.push_back( s );
+	}
+	if ( order % 2 ) {
+		const double K = std::tan( w0 / 2 );
+		const double g = ( lowpass ? K : 1 ) / ( 1 + K );
+		const biquad s = { g, lowpass ? g : -g, 0, ( K - 1 ) / ( K + 1 ), 0 };
+		sections.push_back( s );
+	}
+	return sections;
+}
+
+/*
+  Cascade of second order sections in transposed direct form II, in
+  double, over nb_chan interleaved channels. A block is run section after
+  section through a double buffer. I/Q pairs fill the two lanes of a
+  vector so that both recursions advance in the same instructions; other
+  channel counts are run one channel after the other.
+*/
+typedef double iir_vec __attribute__(( vector_size( 16 ) ));
+
+class iir_filter
+{
+public:
+	iir_filter( const std::vector<biquad>& sections, unsigned int nb_chan )
+		: sections( sections ), nb_chan( nb_chan ), state( 2 * sections.size() * nb_chan, 0. ) {}
+
+	/* n frames of nb_chan samples */
+	template <class Input, class Output>
+	void process( const Input* in, unsigned int n, Output* out )
+	{
+		buff.resize( n * nb_chan );
+		double* x = &buff[0];
+		for ( unsigned int i = 0; i < n * nb_chan; i++ ) {
+			x[ i ] = in[ i ];
+		}
+		for ( unsigned int k = 0; k < sections.size(); k++ ) {
+			double* s = &state[ 2 * k * nb_chan ];
+			if ( nb_chan == 2 ) {
+				run_iq( sections[ k ], x, n, s );
+			} else {
+				for ( unsigned int c = 0; c < nb_chan; c++ ) {
+					run( sections[ k ], x + c, n, s + 2*c );
+				}
+			}
+		}
+		for ( unsigned int i = 0; i < n * nb_chan; i++ ) {
+			out[ i ] = x[ i ];
+		}
+	}
+
+private:
+	void run( const biquad& f, double* x, unsigned int n, double* s )
+	{
+		double s1 = s[ 0 ], s2 = s[ 1 ];
+		for ( unsigned int i = 0; i < n; i++ ) {
+			const double v = x[ i * nb_chan ];
+			const double y = f.b0 * v + s1;
+			s1 = f.b1 * v - f.a1 * y + s2;
+			s2 = f.b2 * v - f.a2 * y;
+			x[ i * nb_chan ] = y;
+		}
+		s[ 0 ] = s1;
+		s[ 1 ] = s2;
+	}
+
+	void run_iq( const biquad& f, double* x, unsigned int n, double* s )
+	{
+		iir_vec s1 = { s[ 0 ], s[ 2 ] }, s2 = { s[ 1 ], s[ 3 ] };
+		for ( unsigned int i = 0; i < n; i++ ) {
+			iir_vec v;
+			__builtin_memcpy( &v, x + 2*i, sizeof(v) );
+			const iir_vec y = f.b0 * v + s1;
+			s1 = f.b1 * v - f.a1 * y + s2;
+			s2 = f.b2 * v - f.a2 * y;
+			__builtin_memcpy( x + 2*i, &y, sizeof(y) );
+		}
+		s[ 0 ] = s1[ 0 ];
+		s[ 1 ] = s2[ 0 ];
+		s[ 2 ] = s1[ 1 ];
+		s[ 3 ] = s2[ 1 ];
+	}
+
+	const std::vector<biquad> sections;
+	const unsigned int nb_chan;
+	std::vector<double> state;  /* s1, s2 of each channel, for each section */
+	std::vector<double> buff;
+};
+
+template <class T>
+void iir( const std::vector<biquad>& sections, const unsigned int nb_chan, const unsigned int block_size, FILE* fd_input, FILE* fd_output )
+{
+	T* in_buff = new T[ nb_chan * block_size ];
+	T* out_buff = new T[ nb_chan * block_size ];
+	iir_filter filter( sections, nb_chan );
+	io_reserve( fd_output, io_remaining( fd_input ) );
+	const T* in;
+	size_t n;
+	while( ( n = io_view( &in, in_buff, nb_chan*sizeof(*in_buff), block_size, fd_input) ) > 0 ) {
+		T* out = io_room( out_buff, nb_chan*sizeof(*out_buff), n, fd_output );
+		filter.process( in, n, out );
+		io_commit( out, nb_chan*sizeof(*out_buff), n, fd_output );
+		io_flush( fd_output );
+	}
+	delete[] out_buff;
+	delete[] in_buff;
+}
+
+#endif
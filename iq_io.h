@@ -0,0 +1,1178 @@
+/*
+  ===========================================================================
+
+  Copyright (C) 2018 Emvivre
+
+  This file is part of IQ_TOOLBOX.
+
+  IQ_TOOLBOX is free software: you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation, either version 3 of the License, or
+  (at your option) any later version.
+
+  IQ_TOOLBOX is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with IQ_TOOLBOX.  If not, see <http://www.gnu.org/licenses/>.
+
+  ===========================================================================
+*/
+
+#ifndef IQ_IO_H
+#define IQ_IO_H
+
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <vector>
+#include <algorithm>
+#include <atomic>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <poll.h>
+#include <signal.h>
+#include <time.h>
+#include <sys/ioctl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/uio.h>
+
+/*
+  Overlapped I/O of the sample streams. The tools call io_read(),
+  io_write() and io_flush() in place of fread(), fwrite() and fflush():
+  the first call on a stream attaches it to a reader or a writer thread,
+  connected to the compute thread by a ring of IO_NB_BLOCK preallocated
+  blocks. The reader thread fills the blocks ahead while the tool
+  computes, the writer thread drains them behind it, so that a stage
+  runs at the pace of the slowest of the three instead of their sum.
+
+  The rings are single producer, single consumer: the block counters are
+  atomics and a side only takes the lock to sleep on an empty or a full
+  ring, or to wake the other side which sleeps on it.
+
+  With a single processor online there is nothing to overlap, the
+  streams are then read and written in place by stdio as before.
+
+  Regular files are mapped instead, in both cases, an output only once
+  io_reserve() has given its size, being written by pwrite() until then.
+  io_view() then gives the next samples in place in the input mapping,
+  and io_room() the place of the next ones in the output mapping, so that
+  a kernel reads and writes the files without any copy. On other streams
+  they fall back to the buffer of the tool, io_commit() writing it.
+
+  Pipes are enlarged to IO_PIPE_LEN instead, which decouples the stages
+  as well as the rings would. The output is gathered in stage buffers
+  (io_room() gives a place in them) and written once IO_FLUSH_LEN bytes
+  are pending or the oldest of them is IO_FLUSH_DELAY old, rather than at
+  every io_flush(), and in any case before the thread waits for its
+  input. With IQ_VMSPLICE set in the environment, the stage buffers are
+  handed to the pipe by vmsplice() without being copied: the next stage
+  must then read() the pipe, not splice() it further, as a buffer is
+  reused once the pipe has been read past it.
+
+  A stream may also be attached to an endpoint of its own beforehand
+  (iq_pipeline links its stages this way), the io_*() calls then going
+  to it.
+
+  The io_*() calls also count, for the thread making them, the samples
+  and blocks read and written and the time spent waiting in them, the
+  rest being computation. The counters of the running threads are
+  printed on stderr on SIGUSR1 and every --stats-interval seconds, or
+  rewritten in the --stats-file, so that a stage starved by its input or
+  held back by its output shows up in a chain.
+*/
+static const unsigned int IO_NB_BLOCK = 4;
+static const size_t IO_BLOCK_LEN = 1 << 18;
+static const int IO_PIPE_LEN = 1 << 20;
+static const unsigned int IO_NB_STAGE = 4;
+static const size_t IO_FLUSH_LEN = 1 << 16;
+static const double IO_FLUSH_DELAY = 0.01; /* s */
+
+class io_endpoint
+{
+public:
+	virtual ~io_endpoint() {}
+	/* blocks until len bytes, or the end of the stream */
+	virtual size_t read( void* buf, size_t len ) = 0;
+	virtual bool write( const void* buf, size_t len ) = 0;
+	virtual void flush() = 0;
+	/* called at exit, the tools leaving their streams open */
+	virtual void close() {}
+
+	/* the next bytes of the stream in place, up to len, else read into buf */
+	virtual const void* view( void* buf, size_t len, size_t& got )
+	{
+		got = read( buf, len );
+		return buf;
+	}
+	/* where to put the next len bytes, buf unless the stream is mapped */
+	virtual void* room( void* buf, size_t ) { return buf; }
+	virtual bool commit( const void* buf, size_t len ) { return write( buf, len ); }
+	/* the bytes left to read, 0 when unknown */
+	virtual unsigned long long remaining() { return 0; }
+	virtual void reserve( unsigned long long ) {}
+};
+
+/* writes what the pipe writers of the calling thread hold, before it waits for its input */
+inline void io_drain_pipes();
+
+struct io_block
+{
+	std::vector<char> data;
+	size_t len;
+};
+
+class io_ring
+{
+public:
+	io_ring() : blocks( IO_NB_BLOCK ), head( 0 ), tail( 0 ), producer_done( false ), consumer_done( false ), nb_sleeper( 0 )
+	{
+		for ( unsigned int i = 0; i < blocks.size(); i++ ) {
+			blocks[ i ].data.resize( IO_BLOCK_LEN );
+			blocks[ i ].len = 0;
+		}
+	}
+
+	/* producer side: the next block to fill, NULL once the consumer is gone */
+	io_block* free_block()
+	{
+		wait( [this]{ return tail - head < blocks.size() || consumer_done; } );
+		return consumer_done ? NULL : &blocks[ tail % blocks.size() ];
+	}
+
+	void push()
+	{
+		tail.store( tail + 1 );
+		wake();
+	}
+
+	/* consumer side: the next filled block, NULL at the end of the stream */
+	io_block* full_block()
+	{
+		wait( [this]{ return head != tail || producer_done; } );
+		return ( head != tail ) ? &blocks[ head % blocks.size() ] : NULL;
+	}
+
+	void pop()
+	{
+		head.store( head + 1 );
+		wake();
+	}
+
+	bool empty() const { return head == tail; }
+	void close_producer() { producer_done = true; wake(); }
+	void close_consumer() { consumer_done = true; wake(); }
+
+private:
+	template <class P>
+	void wait( P ready )
+	{
+		if ( ready() ) {
+			return;
+		}
+		std::unique_lock<std::mutex> lock( m );
+		nb_sleeper++;
+		cv.wait( lock, ready );
+		nb_sleeper--;
+	}
+
+	/* a sleeper has registered under the lock before checking the counters again */
+	void wake()
+	{
+		if ( nb_sleeper > 0 ) {
+			std::lock_guard<std::mutex> lock( m );
+			cv.notify_all();
+		}
+	}
+
+	std::vector<io_block> blocks;
+	std::atomic<unsigned long> head;
+	std::atomic<unsigned long> tail;
+	std::atomic<bool> producer_done;
+	std::atomic<bool> consumer_done;
+	std::atomic<int> nb_sleeper;
+	std::mutex m;
+	std::condition_variable cv;
+};
+
+/* read() straight on the descriptor when there is one, so that a block holds what a pipe has */
+class io_reader : public io_endpoint
+{
+public:
+	io_reader( FILE* fd ) : fd( fd ), current( NULL ), pos( 0 )
+	{
+		std::thread( &io_reader::run, this ).detach();
+	}
+
+	size_t read( void* buf, size_t len )
+	{
+		size_t done = 0;
+		while ( done < len ) {
+			if ( current == NULL && ring.empty() ) {
+				io_drain_pipes();
+			}
+			if ( current == NULL && ( current = ring.full_block() ) == NULL ) {
+				break;
+			}
+			const size_t n = std::min( len - done, current->len - pos );
+			std::memcpy( (char*) buf + done, &current->data[ pos ], n );
+			done += n;
+			pos += n;
+			if ( pos == current->len ) {
+				ring.pop();
+				current = NULL;
+				pos = 0;
+			}
+		}
+		return done;
+	}
+
+	bool write( const void*, size_t ) { return false; }
+	void flush() {}
+
+private:
+	void run()
+	{
+		const int fd_no = fileno( fd );
+		io_block* b;
+		while ( ( b = ring.free_block() ) != NULL ) {
+			if ( fd_no >= 0 ) {
+				ssize_t n;
+				while ( ( n = ::read( fd_no, &b->data[0], b->data.size() ) ) < 0 && errno == EINTR );
+				b->len = ( n > 0 ) ? n : 0;
+			} else {
+				b->len = fread( &b->data[0], 1, b->data.size(), fd );
+			}
+			if ( b->len == 0 ) {
+				break;
+			}
+			ring.push();
+		}
+		ring.close_producer();
+	}
+
+	FILE* fd;
+	io_ring ring;
+	io_block* current;
+	size_t pos;
+};
+
+/* a flush hands the pending block over, the thread flushing the stream when it runs out of blocks */
+class io_writer : public io_endpoint
+{
+public:
+	io_writer( FILE* fd ) : fd( fd ), current( NULL )
+	{
+		fflush( fd );
+		thread = std::thread( &io_writer::run, this );
+	}
+
+	size_t read( void*, size_t ) { return 0; }
+
+	bool write( const void* buf, size_t len )
+	{
+		while ( len > 0 ) {
+			if ( current == NULL ) {
+				if ( ( current = ring.free_block() ) == NULL ) {
+					return false;
+				}
+				current->len = 0;
+			}
+			const size_t n = std::min( len, current->data.size() - current->len );
+			std::memcpy( &current->data[ current->len ], buf, n );
+			current->len += n;
+			buf = (const char*) buf + n;
+			len -= n;
+			if ( current->len == current->data.size() ) {
+				ring.push();
+				current = NULL;
+			}
+		}
+		return true;
+	}
+
+	void flush()
+	{
+		if ( current != NULL && current->len > 0 ) {
+			ring.push();
+			current = NULL;
+		}
+	}
+
+	void close()
+	{
+		flush();
+		ring.close_producer();
+		thread.join();
+	}
+
+private:
+	void run()
+	{
+		const int fd_no = fileno( fd );
+		io_block* b;
+		while ( ( b = ring.full_block() ) != NULL ) {
+			if ( !put( fd_no, &b->data[0], b->len ) ) {
+				ring.close_consumer();
+				break;
+			}
+			ring.pop();
+			if ( fd_no < 0 && ring.empty() ) {
+				fflush( fd );
+			}
+		}
+	}
+
+	bool put( int fd_no, const char* p, size_t len )
+	{
+		if ( fd_no < 0 ) {
+			return fwrite( p, 1, len, fd ) == len;
+		}
+		while ( len > 0 ) {
+			const ssize_t n = ::write( fd_no, p, len );
+			if ( n < 0 && errno == EINTR ) {
+				continue;
+			}
+			if ( n <= 0 ) {
+				return false;
+			}
+			p += n;
+			len -= n;
+		}
+		return true;
+	}
+
+	FILE* fd;
+	io_ring ring;
+	io_block* current;
+	std::thread thread;
+};
+
+class io_stdio : public io_endpoint
+{
+public:
+	io_stdio( FILE* fd ) : fd( fd ) {}
+	size_t read( void* buf, size_t len )
+	{
+		io_drain_pipes();
+		return fread( buf, 1, len, fd );
+	}
+	bool write( const void* buf, size_t len ) { return fwrite( buf, 1, len, fd ) == len; }
+	void flush() { fflush( fd ); }
+
+private:
+	FILE* fd;
+};
+
+/* the whole file is mapped once, from its current offset on */
+class io_mapped_reader : public io_endpoint
+{
+public:
+	io_mapped_reader( int fd_no, off_t size, off_t offset ) : map( NULL ), len( size ), pos( std::min( offset, size ) )
+	{
+		if ( len > 0 ) {
+			map = (char*) mmap( NULL, len, PROT_READ, MAP_SHARED, fd_no, 0 );
+		}
+		if ( map == MAP_FAILED || map == NULL ) {
+			map = NULL;
+			len = pos = 0;
+			return;
+		}
+		madvise( map, len, MADV_SEQUENTIAL );
+		madvise( map, len, MADV_HUGEPAGE );
+	}
+
+	size_t read( void* buf, size_t size )
+	{
+		size_t got;
+		const void* p = view( buf, size, got );
+		std::memcpy( buf, p, got );
+		return got;
+	}
+
+	const void* view( void*, size_t size, size_t& got )
+	{
+		got = std::min<unsigned long long>( size, remaining() );
+		const char* p = map + pos;
+		pos += got;
+		return p;
+	}
+
+	unsigned long long remaining() { return len - pos; }
+	bool write( const void*, size_t ) { return false; }
+	void flush() {}
+
+private:
+	char* map;
+	unsigned long long len;
+	unsigned long long pos;
+};
+
+/*
+  The output is written in place in the file with pwrite(), and only
+  mapped once reserve() tells its size: a live output of unknown length
+  thus never holds more than what was written, even when the tool is
+  interrupted. The reserved blocks are allocated so that a full disk is
+  an error rather than a SIGBUS, and what was not written of them is cut
+  at exit, unless the file was longer to begin with.
+*/
+class io_mapped_writer : public io_endpoint
+{
+public:
+	io_mapped_writer( int fd_no, off_t size, off_t offset ) : fd_no( fd_no ), map( NULL ), file_size( size ), offset( offset ), capacity( 0 ), len( 0 ) {}
+
+	size_t read( void*, size_t ) { return 0; }
+
+	bool write( const void* buf, size_t size )
+	{
+		if ( len + size <= capacity ) {
+			std::memcpy( map + offset + len, buf, size );
+			len += size;
+			return true;
+		}
+		const char* p = (const char*) buf;
+		while ( size > 0 ) {
+			const ssize_t n = pwrite( fd_no, p, size, offset + len );
+			if ( n < 0 && errno == EINTR ) {
+				continue;
+			}
+			if ( n <= 0 ) {
+				return false;
+			}
+			p += n;
+			size -= n;
+			len += n;
+		}
+		return true;
+	}
+
+	void* room( void* buf, size_t size )
+	{
+		return ( len + size <= capacity ) ? map + offset + len : buf;
+	}
+
+	bool commit( const void* buf, size_t size )
+	{
+		if ( map == NULL || buf != map + offset + len ) {
+			return write( buf, size );
+		}
+		len += size;
+		return true;
+	}
+
+	void reserve( unsigned long long size )
+	{
+		const unsigned long long c = len + size;
+		if ( size == 0 || c <= capacity || posix_fallocate( fd_no, offset + capacity, c - capacity ) != 0 ) {
+			return;
+		}
+		void* p = ( map == NULL ) ? mmap( NULL, offset + c, PROT_READ | PROT_WRITE, MAP_SHARED, fd_no, 0 )
+			: mremap( map, offset + capacity, offset + c, MREMAP_MAYMOVE );
+		if ( p == MAP_FAILED ) {
+			return;
+		}
+		map = (char*) p;
+		capacity = c;
+	}
+
+	void flush() {}
+
+	void close()
+	{
+		if ( map == NULL ) {
+			return;
+		}
+		munmap( map, offset + capacity );
+		map = NULL;
+		if ( ftruncate( fd_no, std::max<unsigned long long>( file_size, offset + len ) ) != 0 ) {
+			perror( "ftruncate()" );
+		}
+	}
+
+private:
+	const int fd_no;
+	char* map;
+	const unsigned long long file_size;
+	const unsigned long long offset;
+	unsigned long long capacity;
+	unsigned long long len;
+};
+
+inline double io_now()
+{
+	struct timespec t;
+	clock_gettime( CLOCK_MONOTONIC, &t );
+	return t.tv_sec + t.tv_nsec * 1e-9;
+}
+
+/* write() all of len bytes, false on error */
+inline bool io_put( int fd_no, const char* p, size_t len )
+{
+	while ( len > 0 ) {
+		const ssize_t n = write( fd_no, p, len );
+		if ( n < 0 && errno == EINTR ) {
+			continue;
+		}
+		if ( n <= 0 ) {
+			return false;
+		}
+		p += n;
+		len -= n;
+	}
+	return true;
+}
+
+/*
+  The output is gathered in IO_NB_STAGE buffers of half the pipe size,
+  the pending bytes of the current one [pending, pos) being written by
+  push(). A buffer handed over by vmsplice() is only filled again once
+  the pipe holds less than what was pushed after it (FIONREAD), the
+  output going straight to write() meanwhile.
+*/
+class io_pipe_writer : public io_endpoint
+{
+public:
+	io_pipe_writer( int fd_no, size_t pipe_len, bool splice )
+		: fd_no( fd_no ), splice( splice ), stage_len( pipe_len / 2 ), stage( 0 ), pos( 0 ), pending( 0 ), pending_since( 0 ), pushed( 0 ), end_mark( IO_NB_STAGE, 0 )
+	{
+		void* p = mmap( NULL, IO_NB_STAGE * stage_len, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0 );
+		buff = ( p == MAP_FAILED ) ? NULL : (char*) p;
+		io_thread_pipes().push_back( this );
+	}
+
+	size_t read( void*, size_t ) { return 0; }
+
+	bool write( const void* buf, size_t len )
+	{
+		void* p = ( len < IO_FLUSH_LEN ) ? room( NULL, len ) : NULL;
+		if ( p == NULL ) {
+			return push() && io_put( fd_no, (const char*) buf, len );
+		}
+		std::memcpy( p, buf, len );
+		return commit( p, len );
+	}
+
+	void* room( void* buf, size_t len )
+	{
+		if ( buff == NULL || len > stage_len ) {
+			return buf;
+		}
+		if ( pos + len > stage_len ) {
+			if ( !push() ) {
+				return buf;
+			}
+			stage = ( stage + 1 ) % IO_NB_STAGE;
+			pos = pending = 0;
+		}
+		if ( pos == 0 && !consumed( stage ) ) {
+			return buf;
+		}
+		return current() + pos;
+	}
+
+	bool commit( const void* buf, size_t len )
+	{
+		if ( buff == NULL || buf != current() + pos ) {
+			return push() && io_put( fd_no, (const char*) buf, len );
+		}
+		if ( pos == pending ) {
+			pending_since = io_now();
+		}
+		pos += len;
+		return true;
+	}
+
+	void flush()
+	{
+		if ( pos - pending >= IO_FLUSH_LEN || ( pos > pending && io_now() - pending_since >= IO_FLUSH_DELAY ) ) {
+			push();
+		}
+	}
+
+	bool push()
+	{
+		const char* p = current() + pending;
+		size_t len = pos - pending;
+		if ( !splice ) {
+			if ( !io_put( fd_no, p, len ) ) {
+				return false;
+			}
+		} else {
+			while ( len > 0 ) {
+				struct iovec v = { (void*) p, len };
+				const ssize_t n = vmsplice( fd_no, &v, 1, 0 );
+				if ( n < 0 && errno == EINTR ) {
+					continue;
+				}
+				if ( n <= 0 ) {
+					return false;
+				}
+				p += n;
+				len -= n;
+			}
+		}
+		pushed += pos - pending;
+		end_mark[ stage ] = pushed;
+		pending = pos;
+		return true;
+	}
+
+	void close()
+	{
+		push();
+	}
+
+	bool idle() const { return pos == pending; }
+
+	static std::vector<io_pipe_writer*>& io_thread_pipes()
+	{
+		static thread_local std::vector<io_pipe_writer*> pipes;
+		return pipes;
+	}
+
+private:
+	char* current() { return buff + stage * stage_len; }
+
+	bool consumed( unsigned int s )
+	{
+		int unread = 0;
+		return !splice || ( ioctl( fd_no, FIONREAD, &unread ) == 0 && pushed - end_mark[ s ] >= (unsigned long long) unread );
+	}
+
+	const int fd_no;
+	const bool splice;
+	const size_t stage_len;
+	char* buff;
+	unsigned int stage;
+	size_t pos;
+	size_t pending;
+	double pending_since;
+	unsigned long long pushed;
+	std::vector<unsigned long long> end_mark;  /* pushed at the end of the last push of each stage */
+};
+
+inline bool io_pipes_pending()
+{
+	std::vector<io_pipe_writer*>& pipes = io_pipe_writer::io_thread_pipes();
+	for ( unsigned int i = 0; i < pipes.size(); i++ ) {
+		if ( !pipes[ i ]->idle() ) {
+			return true;
+		}
+	}
+	return false;
+}
+
+inline void io_drain_pipes()
+{
+	std::vector<io_pipe_writer*>& pipes = io_pipe_writer::io_thread_pipes();
+	for ( unsigned int i = 0; i < pipes.size(); i++ ) {
+		pipes[ i ]->push();
+	}
+}
+
+/* read() straight into the buffer of the tool, the pending output being written before it waits */
+class io_pipe_reader : public io_endpoint
+{
+public:
+	io_pipe_reader( int fd_no ) : fd_no( fd_no ) {}
+
+	size_t read( void* buf, size_t len )
+	{
+		size_t done = 0;
+		while ( done < len ) {
+			struct pollfd p = { fd_no, POLLIN, 0 };
+			if ( io_pipes_pending() && poll( &p, 1, 0 ) == 0 ) {
+				io_drain_pipes();
+			}
+			const ssize_t n = ::read( fd_no, (char*) buf + done, len - done );
+			if ( n < 0 && errno == EINTR ) {
+				continue;
+			}
+			if ( n <= 0 ) {
+				break;
+			}
+			done += n;
+		}
+		return done;
+	}
+
+	bool write( const void*, size_t ) { return false; }
+	void flush() {}
+
+private:
+	const int fd_no;
+};
+
+/* a regular file, readable and writable for a mapped output, not appended to */
+inline bool io_mappable( FILE* fd, bool writing )
+{
+	const int fd_no = fileno( fd );
+	struct stat st;
+	if ( fd_no < 0 || fstat( fd_no, &st ) != 0 || !S_ISREG( st.st_mode ) ) {
+		return false;
+	}
+	const int flags = fcntl( fd_no, F_GETFL );
+	return !writing || ( ( flags & O_ACCMODE ) == O_RDWR && !( flags & O_APPEND ) );
+}
+
+/* a pipe, enlarged to IO_PIPE_LEN as far as the system allows it */
+inline bool io_pipe( FILE* fd )
+{
+	const int fd_no = fileno( fd );
+	struct stat st;
+	if ( fd_no < 0 || fstat( fd_no, &st ) != 0 || !S_ISFIFO( st.st_mode ) ) {
+		return false;
+	}
+	if ( fcntl( fd_no, F_GETPIPE_SZ ) < IO_PIPE_LEN ) {
+		fcntl( fd_no, F_SETPIPE_SZ, IO_PIPE_LEN );
+	}
+	return fcntl( fd_no, F_GETPIPE_SZ ) > 0;
+}
+
+struct io_stream
+{
+	FILE* fd;
+	io_endpoint* endpoint;
+};
+
+inline std::vector<io_stream>& io_streams();
+
+inline std::mutex& io_streams_mutex()
+{
+	static std::mutex m;
+	return m;
+}
+
+/* the writers are drained before the exit() flush of the streams they write to, iqz_close_all() calling it first */
+inline void io_close_all()
+{
+	std::vector<io_stream> streams;
+	{
+		std::lock_guard<std::mutex> lock( io_streams_mutex() );
+		streams.swap( io_streams() );
+	}
+	for ( unsigned int i = 0; i < streams.size(); i++ ) {
+		streams[ i ].endpoint->close();
+	}
+}
+
+inline std::vector<io_stream>& io_streams()
+{
+	static std::vector<io_stream> streams;
+	static bool registered = false;
+	if ( !registered ) {
+		registered = true;
+		atexit( io_close_all );
+	}
+	return streams;
+}
+
+inline void io_attach( FILE* fd, io_endpoint* endpoint )
+{
+	std::lock_guard<std::mutex> lock( io_streams_mutex() );
+	const io_stream s = { fd, endpoint };
+	io_streams().push_back( s );
+}
+
+inline void io_detach( FILE* fd )
+{
+	std::lock_guard<std::mutex> lock( io_streams_mutex() );
+	std::vector<io_stream>& streams = io_streams();
+	for ( unsigned int i = 0; i < streams.size(); i++ ) {
+		if ( streams[ i ].fd == fd ) {
+			streams.erase( streams.begin() + i );
+			return;
+		}
+	}
+}
+
+inline io_endpoint* io_endpoint_of( FILE* fd, bool writing )
+{
+	std::lock_guard<std::mutex> lock( io_streams_mutex() );
+	std::vector<io_stream>& streams = io_streams();
+	for ( unsigned int i = 0; i < streams.size(); i++ ) {
+		if ( streams[ i ].fd == fd ) {
+			return streams[ i ].endpoint;
+		}
+	}
+	io_stream s;
+	s.fd = fd;
+	if ( io_mappable( fd, writing ) ) {
+		struct stat st;
+		if ( writing ) {
+			fflush( fd );
+		}
+		fstat( fileno( fd ), &st );
+		if ( writing ) {
+			s.endpoint = new io_mapped_writer( fileno( fd ), st.st_size, ftello( fd ) );
+		} else {
+			s.endpoint = new io_mapped_reader( fileno( fd ), st.st_size, ftello( fd ) );
+		}
+	} else if ( io_pipe( fd ) ) {
+		const int fd_no = fileno( fd );
+		if ( writing ) {
+			fflush( fd );
+			s.endpoint = new io_pipe_writer( fd_no, fcntl( fd_no, F_GETPIPE_SZ ), getenv( "IQ_VMSPLICE" ) != NULL );
+		} else {
+			s.endpoint = new io_pipe_reader( fd_no );
+		}
+	} else if ( std::thread::hardware_concurrency() < 2 ) {
+		s.endpoint = new io_stdio( fd );
+	} else if ( writing ) {
+		s.endpoint = new io_writer( fd );
+	} else {
+		s.endpoint = new io_reader( fd );
+	}
+	streams.push_back( s );
+	return s.endpoint;
+}
+
+/* the time a thread spent waiting in a direction, the current wait included */
+struct io_wait
+{
+	std::atomic<unsigned long long> ns;
+	std::atomic<unsigned long long> since; /* ns, 0 when not waiting */
+
+	double seconds( unsigned long long now ) const
+	{
+		const unsigned long long t0 = since;
+		return ( ns + ( ( t0 > 0 && now > t0 ) ? now - t0 : 0 ) ) * 1e-9;
+	}
+};
+
+/* the counters of a thread, counted by it and read by the reporter thread */
+struct io_counters
+{
+	std::string name;
+	double start;
+	std::atomic<unsigned long long> nb_in;
+	std::atomic<unsigned long long> nb_in_block;
+	std::atomic<unsigned long long> nb_out;
+	std::atomic<unsigned long long> nb_out_block;
+	io_wait read_wait;
+	io_wait write_wait;
+	/* of the reporter */
+	unsigned long long last_in;
+	double last_time;
+	double peak_rate;
+};
+
+struct io_stats_state
+{
+	std::mutex m;
+	std::vector<io_counters*> counters;
+	double interval; /* s, 0 for none */
+	std::string file;
+	int wake[ 2 ];
+	bool started;
+};
+
+inline io_stats_state& io_stats()
+{
+	static io_stats_state* st = new io_stats_state(); /* never destroyed, the reporter may outlive main() */
+	return *st;
+}
+
+/* unregisters the counters of a thread when it ends */
+struct io_counters_owner
+{
+	io_counters* counters;
+
+	~io_counters_owner()
+	{
+		if ( counters != NULL ) {
+			io_stats_state& st = io_stats();
+			std::lock_guard<std::mutex> lock( st.m );
+			st.counters.erase( std::find( st.counters.begin(), st.counters.end(), counters ) );
+			delete counters;
+		}
+	}
+};
+
+inline io_counters& io_thread_counters()
+{
+	static thread_local io_counters_owner owner = { NULL };
+	if ( owner.counters == NULL ) {
+		io_counters* c = new io_counters();
+		c->name = "?";
+		c->start = c->last_time = io_now();
+		c->nb_in = c->nb_in_block = c->nb_out = c->nb_out_block = 0;
+		c->read_wait.ns = c->read_wait.since = 0;
+		c->write_wait.ns = c->write_wait.since = 0;
+		c->last_in = 0;
+		c->peak_rate = 0;
+		io_stats_state& st = io_stats();
+		std::lock_guard<std::mutex> lock( st.m );
+		st.counters.push_back( c );
+		owner.counters = c;
+	}
+	return *owner.counters;
+}
+
+inline unsigned long long io_now_ns()
+{
+	struct timespec t;
+	clock_gettime( CLOCK_MONOTONIC, &t );
+	return t.tv_sec * 1000000000ULL + t.tv_nsec;
+}
+
+/* adds the time spent in its scope to a wait */
+class io_timer
+{
+public:
+	io_timer( io_wait& w ) : w( w ), t0( io_now_ns() )
+	{
+		w.since.store( t0, std::memory_order_relaxed );
+	}
+	~io_timer()
+	{
+		w.since.store( 0, std::memory_order_relaxed );
+		w.ns.fetch_add( io_now_ns() - t0, std::memory_order_relaxed );
+	}
+
+private:
+	io_wait& w;
+	const unsigned long long t0;
+};
+
+/* a line per thread, its rate being the input one since the previous report */
+inline std::string io_stats_report()
+{
+	io_stats_state& st = io_stats();
+	std::lock_guard<std::mutex> lock( st.m );
+	const double t = io_now();
+	const unsigned long long now_ns = io_now_ns();
+	std::string report;
+	for ( unsigned int i = 0; i < st.counters.size(); i++ ) {
+		io_counters& c = *st.counters[ i ];
+		const unsigned long long nb_in = c.nb_in;
+		const double read_wait = c.read_wait.seconds( now_ns );
+		const double write_wait = c.write_wait.seconds( now_ns );
+		const double compute = std::max( 0., t - c.start - read_wait - write_wait );
+		const double rate = ( t > c.last_time ) ? ( nb_in - c.last_in ) / ( t - c.last_time ) : 0;
+		c.peak_rate = std::max( c.peak_rate, rate );
+		c.last_in = nb_in;
+		c.last_time = t;
+		char line[ 1024 ];
+		snprintf( line, sizeof(line), "%u %s : in=%llu in_blocks=%llu out=%llu out_blocks=%llu"
+			" read_wait=%.3f write_wait=%.3f compute=%.3f rate=%.0f peak_rate=%.0f\n",
+			i, c.name.c_str(), nb_in, (unsigned long long) c.nb_in_block,
+			(unsigned long long) c.nb_out, (unsigned long long) c.nb_out_block,
+			read_wait, write_wait, compute, rate, c.peak_rate );
+		report += line;
+	}
+	return report;
+}
+
+/* only wakes the reporter up, saving errno for the interrupted thread */
+inline void io_stats_signal( int )
+{
+	const int e = errno;
+	const char c = 1;
+	if ( write( io_stats().wake[ 1 ], &c, 1 ) < 0 ) {
+		/* already woken up */
+	}
+	errno = e;
+}
+
+/* reports on stderr on SIGUSR1, and at each interval on stderr or in the stats file */
+inline void io_stats_run()
+{
+	io_stats_state& st = io_stats();
+	for (;;) {
+		double interval;
+		std::string file;
+		{
+			std::lock_guard<std::mutex> lock( st.m );
+			interval = st.interval;
+			file = st.file;
+		}
+		struct pollfd p = { st.wake[ 0 ], POLLIN, 0 };
+		const int r = poll( &p, 1, ( interval > 0 ) ? int( interval * 1000 ) : -1 );
+		if ( r < 0 ) {
+			continue;
+		}
+		bool signaled = false;
+		if ( r > 0 ) {
+			char buf[ 64 ];
+			const ssize_t n = read( st.wake[ 0 ], buf, sizeof(buf) );
+			for ( ssize_t k = 0; k < n; k++ ) {
+				signaled = signaled || buf[ k ] == 1;
+			}
+			if ( !signaled ) {
+				continue; /* new settings */
+			}
+		}
+		const std::string report = io_stats_report();
+		if ( signaled || file.empty() ) {
+			fputs( report.c_str(), stderr );
+		}
+		if ( !file.empty() ) {
+			const std::string tmp = file + ".tmp";
+			FILE* f = fopen( tmp.c_str(), "w" );
+			if ( f != NULL ) {
+				fputs( report.c_str(), f );
+				fclose( f );
+				rename( tmp.c_str(), file.c_str() );
+			}
+		}
+	}
+}
+
+/*
+  Names the counters of the calling thread after the program and reads
+  the --stats-interval <SECONDS> and --stats-file <FILE> options, the
+  file being rewritten every second unless an interval is given. The
+  first call installs the SIGUSR1 handler and starts the reporter.
+*/
+inline void io_stats_start( int argc, char** argv )
+{
+	io_counters& c = io_thread_counters();
+	io_stats_state& st = io_stats();
+	std::lock_guard<std::mutex> lock( st.m );
+	c.name = argv[0];
+	bool changed = false;
+	for ( int i = 1; i + 1 < argc; i++ ) {
+		const std::string arg = argv[i];
+		if ( arg == "--stats-interval" ) {
+			st.interval = std::max( 0., atof( argv[i+1] ) );
+			changed = true;
+		} else if ( arg == "--stats-file" ) {
+			st.file = argv[i+1];
+			if ( st.interval <= 0 ) {
+				st.interval = 1;
+			}
+			changed = true;
+		}
+	}
+	if ( !st.started ) {
+		st.started = true;
+		if ( pipe( st.wake ) == 0 ) {
+			fcntl( st.wake[ 0 ], F_SETFD, FD_CLOEXEC );
+			fcntl( st.wake[ 1 ], F_SETFD, FD_CLOEXEC );
+			fcntl( st.wake[ 1 ], F_SETFL, O_NONBLOCK );
+			struct sigaction sa;
+			std::memset( &sa, 0, sizeof(sa) );
+			sa.sa_handler = io_stats_signal;
+			sa.sa_flags = SA_RESTART;
+			sigemptyset( &sa.sa_mask );
+			sigaction( SIGUSR1, &sa, NULL );
+			std::thread( io_stats_run ).detach();
+		}
+	} else if ( changed && st.wake[ 1 ] >= 0 ) {
+		const char w = 0;
+		if ( write( st.wake[ 1 ], &w, 1 ) < 0 ) {
+			/* taken at the next interval */
+		}
+	}
+}
+
+/*
+  Set once a write of the thread failed, its reads then seeing the end of
+  their streams: the tool stops as a SIGPIPE would stop it, which an
+  iq_pipeline stage whose next stage is gone needs.
+*/
+inline bool& io_write_failed()
+{
+	static thread_local bool failed = false;
+	return failed;
+}
+
+inline size_t io_read( void* buf, size_t size, size_t count, FILE* fd )
+{
+	if ( io_write_failed() ) {
+		return 0;
+	}
+	io_counters& c = io_thread_counters();
+	size_t n;
+	{
+		io_timer t( c.read_wait );
+		n = io_endpoint_of( fd, false )->read( buf, size * count ) / size;
+	}
+	c.nb_in.fetch_add( n, std::memory_order_relaxed );
+	c.nb_in_block.fetch_add( 1, std::memory_order_relaxed );
+	return n;
+}
+
+inline size_t io_write( const void* buf, size_t size, size_t count, FILE* fd )
+{
+	io_counters& c = io_thread_counters();
+	io_timer t( c.write_wait );
+	c.nb_out.fetch_add( count, std::memory_order_relaxed );
+	c.nb_out_block.fetch_add( 1, std::memory_order_relaxed );
+	if ( !io_endpoint_of( fd, true )->write( buf, size * count ) ) {
+		io_write_failed() = true;
+		return 0;
+	}
+	return count;
+}
+
+inline int io_flush( FILE* fd )
+{
+	io_timer t( io_thread_counters().write_wait );
+	io_endpoint_of( fd, true )->flush();
+	return 0;
+}
+
+/* count frames of size bytes at most, in place when the input is mapped, else read into buf */
+template <class T>
+size_t io_view( const T** data, T* buf, size_t size, size_t count, FILE* fd )
+{
+	if ( io_write_failed() ) {
+		*data = buf;
+		return 0;
+	}
+	io_counters& c = io_thread_counters();
+	size_t got;
+	{
+		io_timer t( c.read_wait );
+		*data = (const T*) io_endpoint_of( fd, false )->view( buf, size * count, got );
+	}
+	c.nb_in.fetch_add( got / size, std::memory_order_relaxed );
+	c.nb_in_block.fetch_add( 1, std::memory_order_relaxed );
+	return got / size;
+}
+
+/* where to compute the next count frames of size bytes, buf unless the output is mapped */
+template <class T>
+T* io_room( T* buf, size_t size, size_t count, FILE* fd )
+{
+	io_timer t( io_thread_counters().write_wait );
+	return (T*) io_endpoint_of( fd, true )->room( buf, size * count );
+}
+
+/* writes the frames computed at the place given by io_room(), or anywhere else */
+inline size_t io_commit( const void* buf, size_t size, size_t count, FILE* fd )
+{
+	io_counters& c = io_thread_counters();
+	io_timer t( c.write_wait );
+	c.nb_out.fetch_add( count, std::memory_order_relaxed );
+	c.nb_out_block.fetch_add( 1, std::memory_order_relaxed );
+	if ( !io_endpoint_of( fd, true )->commit( buf, size * count ) ) {
+		io_write_failed() = true;
+		return 0;
+	}
+	return count;
+}
+
+/* the bytes left in the input, 0 when it is not a regular file */
+inline unsigned long long io_remaining( FILE* fd )
+{
+	return io_endpoint_of( fd, false )->remaining();
+}
+
+/* preallocates and maps the output for size more bytes, when it is a regular file */
+inline void io_reserve( FILE* fd, unsigned long long size )
+{
+	io_endpoint_of( fd, true )->reserve( size );
+}
+
+#endif
@@ -22,25 +22,32 @@
 */
 
 #include <iostream>
-#include <complex>
-
-static const double PI = 4 * std::atan(1);
+#include "iq_u8.h"
+#include "iq_f16.h"
+#include "iq_capture.h"
+#include "iq_io.h"
+#include "iq_nco.h"
 
 template <class T>
-void mix( const unsigned int sample_rate, const int frequency_mixing, FILE* fd_input, FILE* fd_output )
+void mix( const unsigned int sample_rate, const unsigned int block_size, const double frequency_mixing, FILE* fd_input, FILE* fd_output )
 {
-	T* in_buff = new T[ 2*sample_rate ];
-	T* out_buff = new T[ 2*sample_rate ];
-	while( fread( in_buff, 2*sizeof(*in_buff), sample_rate, fd_input) == sample_rate ) {
-	        for ( unsigned int i = 0; i < sample_rate; i++ ) {
-			std::complex<double> c( in_buff[2*i], in_buff[2*i+1] );
-			c *= std::polar<double>( 1, - 2 * PI * frequency_mixing * i * 1. / sample_rate );
-			out_buff[ 2*i ] = c.real();
-			out_buff[ 2*i+1 ] = c.imag();
-		}
-		fwrite( out_buff, 2*sizeof(*out_buff), sample_rate, fd_output );
-                fflush( fd_output );
+	T* in_buff = new T[ 2*block_size ];
+	T* out_buff = new T[ 2*block_size ];
+	double* re = new double[ block_size ];
+	double* im = new double[ block_size ];
+	nco osc( - frequency_mixing, sample_rate ); /* the mixing phase goes on from one block to the next */
+	io_reserve( fd_output, io_remaining( fd_input ) );
+	const T* in;
+	size_t n;
+	while( ( n = io_view( &in, in_buff, 2*sizeof(*in_buff), block_size, fd_input) ) > 0 ) {
+		T* out = io_room( out_buff, 2*sizeof(*out_buff), n, fd_output );
+		osc.generate( re, im, n );
+		nco_mix( in, re, im, n, out );
+		io_commit( out, 2*sizeof(*out_buff), n, fd_output );
+                io_flush( fd_output );
 	}
+	delete[] im;
+	delete[] re;
 	delete[] out_buff;
 	delete[] in_buff;
 }
@@ -50,15 +57,20 @@ int main(int argc, char** argv)
 	if ( argc < 2 ) {
 		std::cerr << "Usage: " << argv[0] << " <OPTIONS>\n"
 			"  -s <SAMPLE_RATE>\n"
-			"  -d <DATA_FORMAT> : i8 | i16 | i32 | f32 | f64 (default: i16)\n"
+			"  -d <DATA_FORMAT> : i8 | u8 | i16 | i32 | f16 | f32 | f64 (default: i16)\n"
 			"  -m <FREQUENCY_MIXING> (default: 0)\n"
+			"  -b <BLOCK_SIZE> : samples per block, lower for less latency (default: SAMPLE_RATE)\n"
 			"  -i <INPUT_CAPTURE_FILE> (default: -)\n"
-			"  -o <OUTPUT_CAPTURE_FILE> (default: -)\n";
+			"  -o <OUTPUT_CAPTURE_FILE> (default: -)\n"
+			"  --stats-interval <SECONDS> : print the I/O and compute counters every SECONDS on stderr (default: on SIGUSR1 only)\n"
+			"  --stats-file <STATS_FILE> : rewrite the counters in STATS_FILE, every second by default\n";
 		return 1;
 	}
+	io_stats_start( argc, argv );
         const std::string prog_name = argv[0];
 	unsigned int sample_rate = 0;
-	int frequency_mixing = 0;
+	double frequency_mixing = 0;
+	int block_size = 0;
 	std::string data_format = "i16";
 	const char* input_capture_file = "-";
 	const char* output_capture_file = "-";
@@ -68,6 +80,8 @@ int main(int argc, char** argv)
 			sample_rate = atof( argv[i+1] );
 		} else if ( arg == "-m")  {
 			frequency_mixing = atof( argv[i+1] );
+		} else if ( arg == "-b" ) {
+			block_size = atoi( argv[i+1] );
 		} else if ( arg == "-d" ) {
 			data_format = argv[i+1];
 		} else if ( arg == "-i" ) {
@@ -80,17 +94,29 @@ int main(int argc, char** argv)
 		std::cerr << prog_name << " : ERROR: please set a valid sample rate !\n";
 		return 1;
 	}
+	if ( data_format == "cu8" ) {
+		data_format = "u8";
+	}
         if ( data_format != "i8" &&
+	     data_format != "u8" &&
 	     data_format != "i16" &&
 	     data_format != "i32" &&
+	     data_format != "f16" &&
 	     data_format != "f32" &&
 	     data_format != "f64" ) {
 		std::cerr << prog_name << " : ERROR: please set a valid data format !\n";
 		return 1;
 	}
+	if ( block_size < 0 ) {
+		std::cerr << prog_name << " : ERROR: please set a valid block size !\n";
+		return 1;
+	}
+	if ( block_size == 0 ) {
+		block_size = sample_rate;
+	}
 	FILE* fd_input = stdin;
 	if ( input_capture_file != std::string("-") ) {
-		fd_input = fopen( input_capture_file, "rb" );
+		fd_input = capture_open( input_capture_file, "rb", data_format );
 		if ( fd_input == NULL ) {
 			std::cerr << prog_name << " : ";
 			perror("fopen()");
@@ -99,17 +125,19 @@ int main(int argc, char** argv)
 	}
 	FILE* fd_output = stdout;
 	if ( output_capture_file != std::string("-") ) {
-		fd_output = fopen( output_capture_file, "w+b" );
+		fd_output = capture_open( output_capture_file, "w+b", data_format );
 		if ( fd_output == NULL ) {
 			std::cerr << prog_name << " : ";
 			perror("fopen()");
 			return 1;
 		}
 	}
-	if      ( data_format == "i8"  ) { mix<char>( sample_rate, frequency_mixing, fd_input, fd_output); }
-	else if ( data_format == "i16" ) { mix<short>( sample_rate, frequency_mixing, fd_input, fd_output); }
-	else if ( data_format == "i32" ) { mix<int>( sample_rate, frequency_mixing, fd_input, fd_output); }
-	else if ( data_format == "f32" ) { mix<float>( sample_rate, frequency_mixing, fd_input, fd_output); }
-	else if ( data_format == "f64" ) { mix<double>( sample_rate, frequency_mixing, fd_input, fd_output); }
+	if      ( data_format == "i8"  ) { mix<char>( sample_rate, block_size, frequency_mixing, fd_input, fd_output); }
+	else if ( data_format == "u8"  ) { mix<u8_sample>( sample_rate, block_size, frequency_mixing, fd_input, fd_output); }
+	else if ( data_format == "i16" ) { mix<short>( sample_rate, block_size, frequency_mixing, fd_input, fd_output); }
+	else if ( data_format == "i32" ) { mix<int>( sample_rate, block_size, frequency_mixing, fd_input, fd_output); }
+	else if ( data_format == "f16" ) { mix<f16_sample>( sample_rate, block_size, frequency_mixing, fd_input, fd_output); }
+	else if ( data_format == "f32" ) { mix<float>( sample_rate, block_size, frequency_mixing, fd_input, fd_output); }
+	else if ( data_format == "f64" ) { mix<double>( sample_rate, block_size, frequency_mixing, fd_input, fd_output); }
 	return 0;
 }
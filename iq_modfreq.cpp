@@ -24,26 +24,68 @@
 #include <iostream>
 #include <complex>
 #include <limits>
+#include <vector>
+#include <stdint.h>
+#include "iq_u8.h"
+#include "iq_f16.h"
+#include "iq_capture.h"
+#include "iq_io.h"
 
 static const unsigned int BUFFER_LEN = 200000;
+static const int SINE_TABLE_BITS = 12;
+static const unsigned int SINE_TABLE_LEN = 1 << SINE_TABLE_BITS;
+static const double PI = 4 * std::atan(1);
+
+/*
+  Phase modulator: the phase is a 32 bit accumulator wrapping at one turn,
+  so it keeps a resolution of 2 pi / 2^32 however long the modulation runs.
+  Its cosine and sine are linearly interpolated in a table of
+  SINE_TABLE_LEN entries per turn, scaled by the amplitude, for a relative
+  error below ( 2 pi / SINE_TABLE_LEN )^2 / 8 = 3e-7.
+*/
+class phase_modulator
+{
+public:
+	explicit phase_modulator( double amplitude ) : phase( 0 ), table( 2 * ( SINE_TABLE_LEN + 1 ) )
+	{
+		for ( unsigned int k = 0; k <= SINE_TABLE_LEN; k++ ) {
+			table[ 2*k ] = amplitude * std::cos( 2 * PI * k / SINE_TABLE_LEN );
+			table[ 2*k+1 ] = amplitude * std::sin( 2 * PI * k / SINE_TABLE_LEN );
+		}
+	}
+
+	/* advance the phase by the n phase steps of in, in radians, writing the I/Q samples to out */
+	template <class Input, class Output>
+	void process( const Input* in, unsigned int n, Output* out )
+	{
+		const double* t = &table[0];
+		for ( unsigned int i = 0; i < n; i++ ) {
+			double turn = in[ i ] * ( 1 / ( 2 * PI ) );
+			turn -= std::floor( turn );
+			phase += uint32_t( uint64_t( turn * 4294967296. + 0.5 ) ); /* rounded, a truncation would drift */
+			const unsigned int k = phase >> ( 32 - SINE_TABLE_BITS );
+			const double frac = ( phase & ( ( 1u << ( 32 - SINE_TABLE_BITS ) ) - 1 ) ) * ( 1. / ( 1u << ( 32 - SINE_TABLE_BITS ) ) );
+			out[ 2*i ] = t[ 2*k ] + frac * ( t[ 2*k+2 ] - t[ 2*k ] );
+			out[ 2*i+1 ] = t[ 2*k+1 ] + frac * ( t[ 2*k+3 ] - t[ 2*k+1 ] );
+		}
+	}
+
+private:
+	uint32_t phase;
+	std::vector<double> table;
+};
 
 template <class Input, class Output>
 void modfreq_( FILE* fd_input, FILE* fd_output )
 {
 	Input* in_buff = new Input[ BUFFER_LEN ];
 	Output* out_buff = new Output[ 2*BUFFER_LEN ];
-	Output amplitude = 0.5*std::numeric_limits<Output>::max();
+	phase_modulator modulator( Output( 0.5*std::numeric_limits<Output>::max() ) );
         unsigned int nb_sample_read;
-	double phase = 0;
-	while( (nb_sample_read = fread( in_buff, sizeof(*in_buff), BUFFER_LEN, fd_input)) > 0 ) {
-		for ( unsigned int i = 0; i < nb_sample_read; i++ ) {
-			phase += in_buff[ i ];
-			std::complex<double> c = std::polar<double>( amplitude, phase );
-			out_buff[ 2*i ] = c.real();
-			out_buff[ 2*i+1 ] = c.imag();
-	        }
-		fwrite( out_buff, 2*sizeof(*out_buff), nb_sample_read, fd_output );
-                fflush( fd_output );
+	while( (nb_sample_read = io_read( in_buff, sizeof(*in_buff), BUFFER_LEN, fd_input)) > 0 ) {
+		modulator.process( in_buff, nb_sample_read, out_buff );
+		io_write( out_buff, 2*sizeof(*out_buff), nb_sample_read, fd_output );
+                io_flush( fd_output );
 	}
 	delete[] out_buff;
 	delete[] in_buff;
@@ -53,8 +95,10 @@ template <class T>
 void modfreq( const std::string& output_data_format, FILE* fd_input, FILE* fd_output )
 {
 	if      ( output_data_format == "i8"  ) { modfreq_<T,char>( fd_input, fd_output ); }
+	else if ( output_data_format == "u8"  ) { modfreq_<T,u8_sample>( fd_input, fd_output ); }
 	else if ( output_data_format == "i16" ) { modfreq_<T,short>( fd_input, fd_output ); }
 	else if ( output_data_format == "i32" ) { modfreq_<T,int>( fd_input, fd_output ); }
+	else if ( output_data_format == "f16" ) { modfreq_<T,f16_sample>( fd_input, fd_output ); }
 	else if ( output_data_format == "f32" ) { modfreq_<T,float>( fd_input, fd_output ); }
 	else if ( output_data_format == "f64" ) { modfreq_<T,double>( fd_input, fd_output) ; }
 }
@@ -63,12 +107,15 @@ int main(int argc, char** argv)
 {
 	if ( argc < 2 ) {
 		std::cerr << "Usage: " << argv[0] << " <OPTIONS>\n"
-			"  -d <INPUT_DATA_FORMAT> : i8 | i16 | i32 | f32 | f64 (default: i16)\n"
-			"  -D <OUTPUT_DATA_FORMAT> : i8 | i16 | i32 | f32 | f64 (default: i16)\n"
+			"  -d <INPUT_DATA_FORMAT> : i8 | u8 | i16 | i32 | f16 | f32 | f64 (default: i16)\n"
+			"  -D <OUTPUT_DATA_FORMAT> : i8 | u8 | i16 | i32 | f16 | f32 | f64 (default: i16)\n"
 			"  -i <INPUT_CAPTURE_FILE> (default: -)\n"
-			"  -o <OUTPUT_CAPTURE_FILE> (default: -)\n";
+			"  -o <OUTPUT_CAPTURE_FILE> (default: -)\n"
+			"  --stats-interval <SECONDS> : print the I/O and compute counters every SECONDS on stderr (default: on SIGUSR1 only)\n"
+			"  --stats-file <STATS_FILE> : rewrite the counters in STATS_FILE, every second by default\n";
 		return 1;
 	}
+	io_stats_start( argc, argv );
 	const std::string prog_name = argv[0];
 	std::string data_format = "i16";
 	std::string output_data_format = "i16";
@@ -86,17 +133,27 @@ int main(int argc, char** argv)
 			output_capture_file = argv[i+1];
 		}
 	}
+	if ( data_format == "cu8" ) {
+		data_format = "u8";
+	}
 	if ( data_format != "i8" &&
+	     data_format != "u8" &&
 	     data_format != "i16" &&
 	     data_format != "i32" &&
+	     data_format != "f16" &&
 	     data_format != "f32" &&
 	     data_format != "f64" ) {
 		std::cerr << prog_name << " : ERROR: please set a valid data format !\n";
 		return 1;
 	}
+	if ( output_data_format == "cu8" ) {
+		output_data_format = "u8";
+	}
         if ( output_data_format != "i8" &&
+	     output_data_format != "u8" &&
 	     output_data_format != "i16" &&
 	     output_data_format != "i32" &&
+	     output_data_format != "f16" &&
 	     output_data_format != "f32" &&
 	     output_data_format != "f64" ) {
 		std::cerr << prog_name << " : ERROR: please set a valid output data format !\n";
@@ -104,7 +161,7 @@ int main(int argc, char** argv)
 	}
 	FILE* fd_input = stdin;
 	if ( input_capture_file != std::string("-") ) {
-		fd_input = fopen( input_capture_file, "rb" );
+		fd_input = capture_open( input_capture_file, "rb", data_format );
 		if ( fd_input == NULL ) {
 			std::cerr << prog_name << " : ";
 			perror("fopen()");
@@ -113,7 +170,7 @@ int main(int argc, char** argv)
 	}
 	FILE* fd_output = stdout;
 	if ( output_capture_file != std::string("-") ) {
-		fd_output = fopen( output_capture_file, "w+b" );
+		fd_output = capture_open( output_capture_file, "w+b", output_data_format );
 		if ( fd_output == NULL ) {
 			std::cerr << prog_name << " : ";
 			perror("fopen()");
@@ -121,8 +178,10 @@ int main(int argc, char** argv)
 		}
 	}
         if      ( data_format == "i8"  ) { modfreq<char>( output_data_format, fd_input, fd_output ); }
+        else if ( data_format == "u8"  ) { modfreq<u8_sample>( output_data_format, fd_input, fd_output ); }
 	else if ( data_format == "i16" ) { modfreq<short>( output_data_format, fd_input, fd_output ); }
 	else if ( data_format == "i32" ) { modfreq<int>( output_data_format, fd_input, fd_output ); }
+        else if ( data_format == "f16" ) { modfreq<f16_sample>( output_data_format, fd_input, fd_output ); }
 	else if ( data_format == "f32" ) { modfreq<float>( output_data_format, fd_input, fd_output ); }
 	else if ( data_format == "f64" ) { modfreq<double>( output_data_format, fd_input, fd_output ); }
 	return 0;
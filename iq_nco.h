@@ -0,0 +1,132 @@
+/*
+  ===========================================================================
+
+  Copyright (C) 2018 Emvivre
+
+  This file is part of IQ_TOOLBOX.
+
+  IQ_TOOLBOX is free software: you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation, either version 3 of the License, or
+  (at your option) any later version.
+
+  IQ_TOOLBOX is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with IQ_TOOLBOX.  If not, see <http://www.gnu.org/licenses/>.
+
+  ===========================================================================
+*/
+
+#ifndef IQ_NCO_H
+#define IQ_NCO_H
+
+#include <cmath>
+#include <algorithm>
+#include <stdint.h>
+
+/*
+  Numerically controlled oscillator. The phase is a 64 bit accumulator
+  wrapping at one turn, so the frequency resolution is sample_rate / 2^64
+  and the phase goes on exactly from one call to the next. The phasors are
+  computed by recursive rotation, NCO_NB_LANE interleaved sequences being
+  rotated by NCO_NB_LANE steps at once so that the loop vectorizes, and are
+  renormalized from the accumulator every NCO_RENORM samples: the rounding
+  error never grows past a few 1e-14. The renormalizations fall on the
+  multiples of NCO_RENORM of the sample index, the rotation going on from
+  the last phasors of the previous call in between, so that the output
+  does not depend on how the samples are split into calls.
+*/
+static const int NCO_NB_LANE = 8;
+static const unsigned int NCO_RENORM = 1024;
+static const double NCO_TURN = 18446744073709551616.; /* 2^64 */
+
+class nco
+{
+public:
+	nco( double frequency, double sample_rate ) : phase( 0 ), count( 0 )
+	{
+		double r = frequency / sample_rate;
+		r -= std::floor( r );
+		step = ( r * NCO_TURN >= NCO_TURN ) ? 0 : uint64_t( r * NCO_TURN );
+		sincos_turn( step * NCO_NB_LANE, &wr, &wi );
+		std::fill( last_re, last_re + NCO_NB_LANE, 1. );
+		std::fill( last_im, last_im + NCO_NB_LANE, 0. );
+	}
+
+	/* re[i] + j im[i] = exp( j 2 pi frequency t / sample_rate ) for the n next samples */
+	void generate( double* re, double* im, unsigned int n )
+	{
+		for ( unsigned int s = 0; s < n; ) {
+			const unsigned int pos = count % NCO_RENORM;
+			const unsigned int m = std::min( NCO_RENORM - pos, n - s );
+			double* c = re + s;
+			double* d = im + s;
+			/* the first lanes are renormalized, or rotated from the previous call */
+			for ( unsigned int k = 0; k < m && k < (unsigned int) NCO_NB_LANE; k++ ) {
+				const unsigned int lane = ( count + k ) % NCO_NB_LANE;
+				if ( pos + k < (unsigned int) NCO_NB_LANE ) {
+					sincos_turn( phase + k * step, c + k, d + k );
+				} else {
+					c[ k ] = last_re[ lane ] * wr - last_im[ lane ] * wi;
+					d[ k ] = last_re[ lane ] * wi + last_im[ lane ] * wr;
+				}
+			}
+			for ( unsigned int k = NCO_NB_LANE; k < m; k++ ) {
+				c[ k ] = c[ k - NCO_NB_LANE ] * wr - d[ k - NCO_NB_LANE ] * wi;
+				d[ k ] = c[ k - NCO_NB_LANE ] * wi + d[ k - NCO_NB_LANE ] * wr;
+			}
+			for ( unsigned int k = ( m > (unsigned int) NCO_NB_LANE ) ? m - NCO_NB_LANE : 0; k < m; k++ ) {
+				const unsigned int lane = ( count + k ) % NCO_NB_LANE;
+				last_re[ lane ] = c[ k ];
+				last_im[ lane ] = d[ k ];
+			}
+			phase += m * step;
+			count += m;
+			s += m;
+		}
+	}
+
+	/* advance the phase by n samples, the phasors being the ones generate() would have reached */
+	void skip( uint64_t n )
+	{
+		const unsigned int pos = ( count + n ) % NCO_RENORM;
+		phase += ( n - pos ) * step;
+		count += n - pos;
+		double re[ NCO_RENORM ], im[ NCO_RENORM ];
+		generate( re, im, pos );
+	}
+
+private:
+	static void sincos_turn( uint64_t p, double* c, double* s )
+	{
+		const double a = 2 * M_PI * ( p >> 11 ) * ( 1. / ( uint64_t(1) << 53 ) );
+		*c = std::cos( a );
+		*s = std::sin( a );
+	}
+
+	uint64_t phase;
+	uint64_t step;
+	uint64_t count;   /* samples generated or skipped */
+	double last_re[ NCO_NB_LANE ];
+	double last_im[ NCO_NB_LANE ];
+	double wr;
+	double wi;
+};
+
+/* out = in * ( re + j im ), in and out being interleaved I/Q */
+template <class T>
+void nco_mix( const T* in, const double* re, const double* im, unsigned int n, T* out )
+{
+	for ( unsigned int i = 0; i < n; i++ ) {
+		const double x = in[ 2*i ];
+		const double y = in[ 2*i+1 ];
+		out[ 2*i ] = x * re[ i ] - y * im[ i ];
+		out[ 2*i+1 ] = x * im[ i ] + y * re[ i ];
+	}
+}
+
+#endif
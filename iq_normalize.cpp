@@ -24,8 +24,20 @@
 #include <iostream>
 #include <complex>
 #include <limits>
+#include <vector>
+#include <deque>
+#include <algorithm>
+#include <thread>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include "iq_u8.h"
+#include "iq_f16.h"
+#include "iq_capture.h"
+#include "iq_io.h"
 
 static const unsigned int BUFFER_LEN = 20000;
+static const unsigned long long CHUNK_LEN = 1 << 20; /* frames per chunk of the global mode written to a pipe */
 
 template <class T>
 void normalize_scalar( double max_norm, FILE* fd_input, FILE* fd_output )
@@ -33,20 +45,23 @@ void normalize_scalar( double max_norm, FILE* fd_input, FILE* fd_output )
 	T* in_buff = new T[ BUFFER_LEN ];
 	T* out_buff = new T[ BUFFER_LEN ];
 	double max = -std::numeric_limits<double>::infinity();
+	io_reserve( fd_output, io_remaining( fd_input ) );
+	const T* in;
 	unsigned int nb_sample_read;
-	while( (nb_sample_read = fread( in_buff, sizeof(*in_buff), BUFFER_LEN, fd_input)) > 0 ) {
+	while( (nb_sample_read = io_view( &in, in_buff, sizeof(*in_buff), BUFFER_LEN, fd_input)) > 0 ) {
+		T* out = io_room( out_buff, sizeof(*out_buff), nb_sample_read, fd_output );
 		for ( unsigned int i = 0; i < nb_sample_read; i++ ) {
-			const T v = in_buff[ i ];
+			const T v = in[ i ];
 			double n = (v > 0) ? v : -v;
 			if ( n > max ) {
 				max = n;
 			}
 		}
 		for ( unsigned int i = 0; i < nb_sample_read; i++ ) {
-			out_buff[ i ] = max_norm * in_buff[ i ] / max;
+			out[ i ] = max_norm * in[ i ] / max;
 		}
-		fwrite( out_buff, sizeof(*out_buff), nb_sample_read, fd_output );
-                fflush( fd_output );
+		io_commit( out, sizeof(*out_buff), nb_sample_read, fd_output );
+                io_flush( fd_output );
 	}
 	delete[] out_buff;
 	delete[] in_buff;
@@ -58,38 +73,347 @@ void normalize_iq( double max_norm, FILE* fd_input, FILE* fd_output )
 	T* in_buff = new T[ 2*BUFFER_LEN ];
 	T* out_buff = new T[ 2*BUFFER_LEN ];
 	double max = -std::numeric_limits<double>::infinity();
+	io_reserve( fd_output, io_remaining( fd_input ) );
+	const T* in;
 	unsigned int nb_sample_read;
-	while( (nb_sample_read = fread( in_buff, 2*sizeof(*in_buff), BUFFER_LEN, fd_input)) > 0 ) {
+	while( (nb_sample_read = io_view( &in, in_buff, 2*sizeof(*in_buff), BUFFER_LEN, fd_input)) > 0 ) {
+		T* out = io_room( out_buff, 2*sizeof(*out_buff), nb_sample_read, fd_output );
 		for ( unsigned int i = 0; i < nb_sample_read; i++ ) {
-			const std::complex<double> c (in_buff[ 2*i ], in_buff[ 2*i+1 ]);
+			const std::complex<double> c (in[ 2*i ], in[ 2*i+1 ]);
 			double n = std::abs( c );
 			if ( n > max ) {
 				max = n;
 			}
 		}
 		for ( unsigned int i = 0; i < nb_sample_read; i++ ) {
-			out_buff[ 2*i ] = max_norm * in_buff[ 2*i ] / max;
-			out_buff[ 2*i+1 ] = max_norm * in_buff[ 2*i+1 ] / max;
+			out[ 2*i ] = max_norm * in[ 2*i ] / max;
+			out[ 2*i+1 ] = max_norm * in[ 2*i+1 ] / max;
 		}
-		fwrite( out_buff, 2*sizeof(*out_buff), nb_sample_read, fd_output );
+		io_commit( out, 2*sizeof(*out_buff), nb_sample_read, fd_output );
 	}
 	delete[] out_buff;
 	delete[] in_buff;
 }
 
+/*
+  Automatic gain control: the level of the signal is tracked on a sliding
+  window of the last window_len samples, either its peak (monotonic deque
+  of the candidate maxima) or its RMS (running sum of the squared
+  magnitudes). The gain reaching max_value / level is smoothed with the
+  attack time constant when it decreases and the decay one when it
+  increases. The output is delayed by look_ahead samples, so the gain has
+  already been lowered when a peak reaches the output: the window is
+  extended by look_ahead samples, so that it holds the window_len samples
+  up to the one leaving the delay line, whatever the look ahead.
+*/
+class agc
+{
+public:
+	agc( const std::string& mode, double max_value, unsigned int window_len, double attack, double decay, unsigned int look_ahead, int nb_chan )
+		: peak( mode == "peak" ), max_value( max_value ), window_len( window_len + look_ahead ), look_ahead( look_ahead ), nb_chan( nb_chan ),
+		  attack_coef( ( attack > 0 ) ? 1 - std::exp( -1 / attack ) : 1 ), decay_coef( ( decay > 0 ) ? 1 - std::exp( -1 / decay ) : 1 ),
+		  t( 0 ), gain( -1 ), sum( 0 ), level_ring( window_len + look_ahead, 0. ), delay( nb_chan * std::max( look_ahead, 1u ), 0. )
+	{
+	}
+
+	/* x and y hold n frames of nb_chan interleaved samples, y being x delayed by look_ahead frames */
+	void process( const double* x, unsigned int n, double* y )
+	{
+		level.resize( n );
+		for ( unsigned int i = 0; i < n; i++ ) {
+			double l = x[ nb_chan*i ] * x[ nb_chan*i ];
+			if ( nb_chan == 2 ) {
+				l += x[ 2*i+1 ] * x[ 2*i+1 ];
+			}
+			level[ i ] = l;
+		}
+		for ( unsigned int i = 0; i < n; i++, t++ ) {
+			update_gain( track( level[ i ] ) );
+			if ( look_ahead == 0 ) {
+				for ( int c = 0; c < nb_chan; c++ ) {
+					y[ nb_chan*i + c ] = x[ nb_chan*i + c ] * gain;
+				}
+				continue;
+			}
+			/* the slot of the frame t holds the frame t - look_ahead */
+			double* d = &delay[ nb_chan * ( t % look_ahead ) ];
+			for ( int c = 0; c < nb_chan; c++ ) {
+				y[ nb_chan*i + c ] = d[ c ] * gain;
+				d[ c ] = x[ nb_chan*i + c ];
+			}
+		}
+	}
+
+	/* write the look_ahead frames still delayed at the end of the stream, return their number */
+	unsigned int flush( double* y )
+	{
+		const unsigned int n = std::min<unsigned long long>( look_ahead, t );
+		for ( unsigned int i = 0; i < n; i++ ) {
+			const double* d = &delay[ nb_chan * ( ( t - n + i ) % look_ahead ) ];
+			for ( int c = 0; c < nb_chan; c++ ) {
+				y[ nb_chan*i + c ] = d[ c ] * gain;
+			}
+		}
+		return n;
+	}
+
+	/* number of frames to skip at the start of the output, filled by the delay line */
+	unsigned int latency() const { return look_ahead; }
+
+private:
+	/* squared level of the window ending at the sample t */
+	double track( double l )
+	{
+		if ( peak ) {
+			while ( !maxima.empty() && maxima.back().second <= l ) {
+				maxima.pop_back();
+			}
+			maxima.push_back( std::make_pair( t, l ) );
+			if ( maxima.front().first + window_len <= t ) {
+				maxima.pop_front();
+			}
+			return maxima.front().second;
+		}
+		double& old = level_ring[ t % window_len ];
+		sum += l - old;
+		old = l;
+		if ( t % window_len == window_len - 1 ) {
+			/* the running sum is rebuilt once per window so that its rounding does not accumulate */
+			sum = 0;
+			for ( unsigned int k = 0; k < window_len; k++ ) {
+				sum += level_ring[ k ];
+			}
+		}
+		return std::max( sum, 0. ) / std::min<unsigned long long>( t + 1, window_len );
+	}
+
+	void update_gain( double l )
+	{
+		if ( l <= 0 ) {
+			return;
+		}
+		const double target = max_value / std::sqrt( l );
+		if ( gain < 0 ) {
+			gain = target;
+		} else {
+			gain += ( target - gain ) * ( ( target < gain ) ? attack_coef : decay_coef );
+		}
+	}
+
+	const bool peak;
+	const double max_value;
+	const unsigned int window_len;
+	const unsigned int look_ahead;
+	const int nb_chan;
+	const double attack_coef;
+	const double decay_coef;
+	unsigned long long t;
+	double gain;
+	double sum;
+	std::vector<double> level_ring;
+	std::deque< std::pair<unsigned long long, double> > maxima;
+	std::vector<double> delay;
+	std::vector<double> level;
+};
+
+template <class T>
+void normalize_agc( const int nb_chan, const std::string& mode, double max_norm, unsigned int window_len, double attack, double decay, unsigned int look_ahead, FILE* fd_input, FILE* fd_output )
+{
+	agc control( mode, max_norm, window_len, attack, decay, look_ahead, nb_chan );
+	T* in_buff = new T[ nb_chan * BUFFER_LEN ];
+	T* out_buff = new T[ nb_chan * std::max( BUFFER_LEN, look_ahead ) ];
+	double* x = new double[ nb_chan * BUFFER_LEN ];
+	double* y = new double[ nb_chan * std::max( BUFFER_LEN, look_ahead ) ];
+	unsigned int skip = control.latency();
+	unsigned int nb_sample_read;
+	while( (nb_sample_read = io_read( in_buff, nb_chan*sizeof(*in_buff), BUFFER_LEN, fd_input)) > 0 ) {
+		for ( unsigned int i = 0; i < nb_chan * nb_sample_read; i++ ) {
+			x[ i ] = in_buff[ i ];
+		}
+		control.process( x, nb_sample_read, y );
+		const unsigned int s = std::min( skip, nb_sample_read );
+		for ( unsigned int i = nb_chan * s; i < nb_chan * nb_sample_read; i++ ) {
+			out_buff[ i ] = y[ i ];
+		}
+		io_write( out_buff + nb_chan * s, nb_chan*sizeof(*out_buff), nb_sample_read - s, fd_output );
+		io_flush( fd_output );
+		skip -= s;
+	}
+	const unsigned int n = control.flush( y );
+	for ( unsigned int i = 0; i < nb_chan * n; i++ ) {
+		out_buff[ i ] = y[ i ];
+	}
+	io_write( out_buff, nb_chan*sizeof(*out_buff), n, fd_output );
+	io_flush( fd_output );
+	delete[] y;
+	delete[] x;
+	delete[] out_buff;
+	delete[] in_buff;
+}
+
+/* squared magnitude of the frame i of nb_chan interleaved samples */
+template <class T>
+inline double frame_level( const T* x, const int nb_chan, const unsigned long long i )
+{
+	double l = double( x[ nb_chan*i ] ) * x[ nb_chan*i ];
+	if ( nb_chan == 2 ) {
+		l += double( x[ 2*i+1 ] ) * x[ 2*i+1 ];
+	}
+	return l;
+}
+
+struct level_stats
+{
+	double max;
+	double sum;
+};
+
+template <class T>
+void reduce_level( const T* x, const int nb_chan, unsigned long long begin, unsigned long long end, level_stats* res )
+{
+	double max = 0, sum = 0;
+	for ( unsigned long long i = begin; i < end; i++ ) {
+		const double l = frame_level( x, nb_chan, i );
+		max = std::max( max, l );
+		sum += l;
+	}
+	res->max = max;
+	res->sum = sum;
+}
+
+/* the frames [ begin, end [ of x scaled into y, which starts at the frame y_first */
+template <class T>
+void scale( const T* x, const int nb_chan, const double gain, unsigned long long begin, unsigned long long end, T* y, unsigned long long y_first )
+{
+	for ( unsigned long long i = nb_chan * begin; i < nb_chan * end; i++ ) {
+		y[ i - nb_chan * y_first ] = x[ i ] * gain;
+	}
+}
+
+/*
+  Global normalization of a regular input file: the file is memory mapped,
+  its peak or RMS level is reduced by nb_threads workers over contiguous
+  ranges of frames, then every sample is scaled by the same gain. When the
+  output is a regular file open for reading and writing, and not for
+  appending, it is memory mapped too and written by the workers in place,
+  otherwise chunks are scaled in parallel and written in order. Both
+  streams are taken from their current offset, like io_mapped_reader and
+  io_mapped_writer.
+*/
+template <class T>
+int normalize_global( const int nb_chan, const bool rms, const double max_norm, const int nb_threads, FILE* fd_input, FILE* fd_output )
+{
+	const int fd = fileno( fd_input );
+	struct stat st;
+	if ( fstat( fd, &st ) != 0 || !S_ISREG( st.st_mode ) ) {
+		std::cerr << "global normalization needs a regular input file\n";
+		return 1;
+	}
+	const unsigned long long frame = nb_chan * sizeof(T);
+	const unsigned long long in_offset = std::min<unsigned long long>( std::max<off_t>( ftello( fd_input ), 0 ), st.st_size );
+	const unsigned long long nb_frame = ( st.st_size - in_offset ) / frame;
+	if ( nb_frame == 0 ) {
+		return 0;
+	}
+	const unsigned long long in_len = in_offset + nb_frame * frame;
+	void* in_map = mmap( NULL, in_len, PROT_READ, MAP_SHARED, fd, 0 );
+	if ( in_map == MAP_FAILED ) {
+		perror( "mmap()" );
+		return 1;
+	}
+	madvise( in_map, in_len, MADV_SEQUENTIAL );
+	const T* x = (const T*) ( (const char*) in_map + in_offset );
+	const unsigned long long range = ( nb_frame + nb_threads - 1 ) / nb_threads;
+
+	std::vector<level_stats> stats( nb_threads );
+	std::vector<std::thread> workers;
+	for ( int t = 0; t < nb_threads; t++ ) {
+		const unsigned long long begin = std::min( nb_frame, t * range );
+		const unsigned long long end = std::min( nb_frame, begin + range );
+		workers.push_back( std::thread( reduce_level<T>, x, nb_chan, begin, end, &stats[ t ] ) );
+	}
+	double max = 0, sum = 0;
+	for ( int t = 0; t < nb_threads; t++ ) {
+		workers[ t ].join();
+		max = std::max( max, stats[ t ].max );
+		sum += stats[ t ].sum;
+	}
+	workers.clear();
+	const double level = std::sqrt( rms ? sum / nb_frame : max );
+	const double gain = ( level > 0 ) ? max_norm / level : 0;
+	std::cerr << "level: " << level << " gain: " << gain << "\n";
+
+	const int fd_out = fileno( fd_output );
+	void* out_map = MAP_FAILED;
+	unsigned long long out_len = 0;
+	if ( io_mappable( fd_output, true ) && fflush( fd_output ) == 0 && fstat( fd_out, &st ) == 0 ) {
+		const off_t out_offset = ftello( fd_output );
+		out_len = out_offset + nb_frame * frame;
+		if ( out_offset >= 0 && ( (unsigned long long) st.st_size >= out_len || ftruncate( fd_out, out_len ) == 0 ) ) {
+			out_map = mmap( NULL, out_len, PROT_READ | PROT_WRITE, MAP_SHARED, fd_out, 0 );
+		}
+	}
+	if ( out_map != MAP_FAILED ) {
+		T* y = (T*) ( (char*) out_map + ( out_len - nb_frame * frame ) );
+		for ( int t = 0; t < nb_threads; t++ ) {
+			const unsigned long long begin = std::min( nb_frame, t * range );
+			const unsigned long long end = std::min( nb_frame, begin + range );
+			workers.push_back( std::thread( scale<T>, x, nb_chan, gain, begin, end, y, 0ULL ) );
+		}
+		for ( int t = 0; t < nb_threads; t++ ) {
+			workers[ t ].join();
+		}
+		munmap( out_map, out_len );
+	} else {
+		std::vector< std::vector<T> > out( nb_threads, std::vector<T>( nb_chan * CHUNK_LEN ) );
+		for ( unsigned long long first = 0; first < nb_frame; first += nb_threads * CHUNK_LEN ) {
+			for ( int t = 0; t < nb_threads; t++ ) {
+				const unsigned long long begin = std::min( nb_frame, first + t * CHUNK_LEN );
+				const unsigned long long end = std::min( nb_frame, begin + CHUNK_LEN );
+				workers.push_back( std::thread( scale<T>, x, nb_chan, gain, begin, end, &out[ t ][0], begin ) );
+			}
+			for ( int t = 0; t < nb_threads; t++ ) {
+				workers[ t ].join();
+				const unsigned long long begin = std::min( nb_frame, first + t * CHUNK_LEN );
+				const unsigned long long end = std::min( nb_frame, begin + CHUNK_LEN );
+				io_write( &out[ t ][0], frame, end - begin, fd_output );
+			}
+			io_flush( fd_output );
+			workers.clear();
+		}
+	}
+	munmap( in_map, in_len );
+	return 0;
+}
+
 int main(int argc, char** argv)
 {
 	if ( argc < 2 ) {
 		std::cerr << "Usage: " << argv[0] << " <OPTIONS>\n"
 			"  -m <MAX_VALUE> (default: 0)\n"
+			"  -a <AGC_MODE> : max (running maximum) | peak | rms | global | global_rms (default: max)\n"
+			"  -w <WINDOW> : peak / rms window, in samples (default: 4096)\n"
+			"  -A <ATTACK> : gain attack time constant, in samples (default: 0)\n"
+			"  -R <DECAY> : gain decay time constant, in samples (default: WINDOW)\n"
+			"  -l <LOOK_AHEAD> : output delay letting the gain anticipate the peaks, in samples (default: 0)\n"
+			"  -j <NB_THREADS> : global modes, on a regular input file (default: 1)\n"
 			"  -t <SIGNAL_TYPE> : scalar | iq (default: iq)\n"
-			"  -d <DATA_FORMAT> : i8 | i16 | i32 | f32 | f64 (default: i16)\n"
+			"  -d <DATA_FORMAT> : i8 | u8 | i16 | i32 | f16 | f32 | f64 (default: i16)\n"
 			"  -i <INPUT_CAPTURE_FILE> (default: -)\n"
-			"  -o <OUTPUT_CAPTURE_FILE> (default: -)\n";
+			"  -o <OUTPUT_CAPTURE_FILE> (default: -)\n"
+			"  --stats-interval <SECONDS> : print the I/O and compute counters every SECONDS on stderr (default: on SIGUSR1 only)\n"
+			"  --stats-file <STATS_FILE> : rewrite the counters in STATS_FILE, every second by default\n";
 		return 1;
 	}
+	io_stats_start( argc, argv );
         const std::string prog_name = argv[0];
 	double max_value = 0;
+	std::string agc_mode = "max";
+	int window_len = 4096;
+	double attack = 0;
+	double decay = -1;
+	int look_ahead = 0;
+	int nb_threads = 1;
 	std::string data_format = "i16";
 	std::string signal_type = "iq";
 	const char* input_capture_file = "-";
@@ -98,6 +422,18 @@ int main(int argc, char** argv)
 		std::string arg = argv[i];
 	        if ( arg == "-m" ) {
 			max_value = atof( argv[i+1] );
+		} else if ( arg == "-a" ) {
+			agc_mode = argv[i+1];
+		} else if ( arg == "-w" ) {
+			window_len = atoi( argv[i+1] );
+		} else if ( arg == "-A" ) {
+			attack = atof( argv[i+1] );
+		} else if ( arg == "-R" ) {
+			decay = atof( argv[i+1] );
+		} else if ( arg == "-l" ) {
+			look_ahead = atoi( argv[i+1] );
+		} else if ( arg == "-j" ) {
+			nb_threads = atoi( argv[i+1] );
 		} else if ( arg == "-t" ) {
 			signal_type = argv[i+1];
 		} else if ( arg == "-d" ) {
@@ -108,9 +444,14 @@ int main(int argc, char** argv)
 			output_capture_file = argv[i+1];
 		}
 	}
+	if ( data_format == "cu8" ) {
+		data_format = "u8";
+	}
 	if ( data_format != "i8" &&
+	     data_format != "u8" &&
 	     data_format != "i16" &&
 	     data_format != "i32" &&
+	     data_format != "f16" &&
 	     data_format != "f32" &&
 	     data_format != "f64" ) {
 		std::cerr << prog_name << " : ERROR: please set a valid data format !\n";
@@ -120,9 +461,32 @@ int main(int argc, char** argv)
 		std::cerr << prog_name << " : ERROR: please set a valid signal type !\n";
 		return 1;
 	}
+	if ( agc_mode != "max" && agc_mode != "peak" && agc_mode != "rms" && agc_mode != "global" && agc_mode != "global_rms" ) {
+		std::cerr << prog_name << " : ERROR: please set a valid agc mode !\n";
+		return 1;
+	}
+	if ( window_len <= 0 ) {
+		std::cerr << prog_name << " : ERROR: please set a valid window !\n";
+		return 1;
+	}
+	if ( attack < 0 ) {
+		std::cerr << prog_name << " : ERROR: please set a valid attack !\n";
+		return 1;
+	}
+	if ( decay < 0 ) {
+		decay = window_len;
+	}
+	if ( look_ahead < 0 ) {
+		std::cerr << prog_name << " : ERROR: please set a valid look ahead !\n";
+		return 1;
+	}
+	if ( nb_threads <= 0 ) {
+		std::cerr << prog_name << " : ERROR: please set a valid number of threads !\n";
+		return 1;
+	}
 	FILE* fd_input = stdin;
 	if ( input_capture_file != std::string("-") ) {
-		fd_input = fopen( input_capture_file, "rb" );
+		fd_input = capture_open( input_capture_file, "rb", data_format );
 		if ( fd_input == NULL ) {
 			std::cerr << prog_name << " : ";
 			perror("fopen()");
@@ -131,23 +495,51 @@ int main(int argc, char** argv)
 	}
 	FILE* fd_output = stdout;
 	if ( output_capture_file != std::string("-") ) {
-		fd_output = fopen( output_capture_file, "w+b" );
+		fd_output = capture_open( output_capture_file, "w+b", data_format );
 		if ( fd_output == NULL ) {
 			std::cerr << prog_name << " : ";
 			perror("fopen()");
 			return 1;
 		}
 	}
-        if ( signal_type == "scalar" ) {
+	if ( agc_mode == "global" || agc_mode == "global_rms" ) {
+		const int nb_chan = ( signal_type == "scalar" ) ? 1 : 2;
+		const bool rms = ( agc_mode == "global_rms" );
+		int r = 0;
+		if      ( data_format == "i8"  ) { r = normalize_global<char>( nb_chan, rms, max_value, nb_threads, fd_input, fd_output); }
+		else if ( data_format == "u8"  ) { r = normalize_global<u8_sample>( nb_chan, rms, max_value, nb_threads, fd_input, fd_output); }
+		else if ( data_format == "i16" ) { r = normalize_global<short>( nb_chan, rms, max_value, nb_threads, fd_input, fd_output); }
+		else if ( data_format == "i32" ) { r = normalize_global<int>( nb_chan, rms, max_value, nb_threads, fd_input, fd_output); }
+		else if ( data_format == "f16" ) { r = normalize_global<f16_sample>( nb_chan, rms, max_value, nb_threads, fd_input, fd_output); }
+		else if ( data_format == "f32" ) { r = normalize_global<float>( nb_chan, rms, max_value, nb_threads, fd_input, fd_output); }
+		else if ( data_format == "f64" ) { r = normalize_global<double>( nb_chan, rms, max_value, nb_threads, fd_input, fd_output); }
+		if ( r != 0 ) {
+			std::cerr << prog_name << " : ERROR: global normalization failed !\n";
+		}
+		return r;
+	} else if ( agc_mode != "max" ) {
+		const int nb_chan = ( signal_type == "scalar" ) ? 1 : 2;
+		if      ( data_format == "i8"  ) { normalize_agc<char>( nb_chan, agc_mode, max_value, window_len, attack, decay, look_ahead, fd_input, fd_output); }
+		else if ( data_format == "u8"  ) { normalize_agc<u8_sample>( nb_chan, agc_mode, max_value, window_len, attack, decay, look_ahead, fd_input, fd_output); }
+		else if ( data_format == "i16" ) { normalize_agc<short>( nb_chan, agc_mode, max_value, window_len, attack, decay, look_ahead, fd_input, fd_output); }
+		else if ( data_format == "i32" ) { normalize_agc<int>( nb_chan, agc_mode, max_value, window_len, attack, decay, look_ahead, fd_input, fd_output); }
+		else if ( data_format == "f16" ) { normalize_agc<f16_sample>( nb_chan, agc_mode, max_value, window_len, attack, decay, look_ahead, fd_input, fd_output); }
+		else if ( data_format == "f32" ) { normalize_agc<float>( nb_chan, agc_mode, max_value, window_len, attack, decay, look_ahead, fd_input, fd_output); }
+		else if ( data_format == "f64" ) { normalize_agc<double>( nb_chan, agc_mode, max_value, window_len, attack, decay, look_ahead, fd_input, fd_output); }
+	} else if ( signal_type == "scalar" ) {
 		if      ( data_format == "i8"  ) { normalize_scalar<char>( max_value, fd_input, fd_output); }
+		else if ( data_format == "u8"  ) { normalize_scalar<u8_sample>( max_value, fd_input, fd_output); }
 		else if ( data_format == "i16" ) { normalize_scalar<short>( max_value, fd_input, fd_output); }
 		else if ( data_format == "i32" ) { normalize_scalar<int>( max_value, fd_input, fd_output); }
+		else if ( data_format == "f16" ) { normalize_scalar<f16_sample>( max_value, fd_input, fd_output); }
 		else if ( data_format == "f32" ) { normalize_scalar<float>( max_value, fd_input, fd_output); }
 		else if ( data_format == "f64" ) { normalize_scalar<double>( max_value, fd_input, fd_output); }
 	} else {
 		if      ( data_format == "i8"  ) { normalize_iq<char>( max_value, fd_input, fd_output); }
+		else if ( data_format == "u8"  ) { normalize_iq<u8_sample>( max_value, fd_input, fd_output); }
 		else if ( data_format == "i16" ) { normalize_iq<short>( max_value, fd_input, fd_output); }
 		else if ( data_format == "i32" ) { normalize_iq<int>( max_value, fd_input, fd_output); }
+		else if ( data_format == "f16" ) { normalize_iq<f16_sample>( max_value, fd_input, fd_output); }
 		else if ( data_format == "f32" ) { normalize_iq<float>( max_value, fd_input, fd_output); }
 		else if ( data_format == "f64" ) { normalize_iq<double>( max_value, fd_input, fd_output); }
 	}
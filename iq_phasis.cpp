@@ -23,53 +23,70 @@
 
 #include <iostream>
 #include <complex>
+#include "iq_u8.h"
+#include "iq_f16.h"
+#include "iq_capture.h"
+#include "iq_io.h"
+#include "iq_discriminator.h"
 
 static const unsigned int BUFFER_LEN = 200000;
 
 template <class Input, class Output>
-void phasis_( FILE* fd_input, FILE* fd_output )
+void phasis_( const std::string& accuracy, FILE* fd_input, FILE* fd_output )
 {
-	Input* in_buff = new Input[ 2*BUFFER_LEN ];
-	Output* out_buff = new Output[ 2*BUFFER_LEN ];
-	std::complex<double> c_prev(0,0);
+	Input* in_buff = new Input[ 2*BUFFER_LEN + 2 ]; /* the previous sample, then the block */
+	Output* out_buff = new Output[ BUFFER_LEN ];
+	double* phase = new double[ BUFFER_LEN ];
+	discriminator discri( accuracy, BUFFER_LEN );
+	in_buff[ 0 ] = in_buff[ 1 ] = 0;
+	io_reserve( fd_output, io_remaining( fd_input ) / ( 2*sizeof(Input) ) * sizeof(Output) );
 	unsigned int nb_sample_read;
-	while( (nb_sample_read = fread( in_buff, 2*sizeof(*in_buff), BUFFER_LEN, fd_input)) > 0 ) {
+	while( (nb_sample_read = io_read( in_buff + 2, 2*sizeof(*in_buff), BUFFER_LEN, fd_input)) > 0 ) {
+		Output* out = io_room( out_buff, sizeof(*out_buff), nb_sample_read, fd_output );
+		discri.process( in_buff + 2, nb_sample_read, phase );
 		for ( unsigned int i = 0; i < nb_sample_read; i++ ) {
-			std::complex<double> c( in_buff[2*i], in_buff[2*i+1] );
-		        double phasis = std::arg( c * std::conj(c_prev) );
-			out_buff[ i ] = phasis;
-			c_prev = c;
+			out[ i ] = phase[ i ];
 		}
-		fwrite( out_buff, sizeof(*out_buff), nb_sample_read, fd_output );
-                fflush( fd_output );
+		in_buff[ 0 ] = in_buff[ 2*nb_sample_read ];
+		in_buff[ 1 ] = in_buff[ 2*nb_sample_read+1 ];
+		io_commit( out, sizeof(*out_buff), nb_sample_read, fd_output );
+                io_flush( fd_output );
 	}
+	delete[] phase;
 	delete[] out_buff;
 	delete[] in_buff;
 }
 
 template <class T>
-void phasis( const std::string& output_data_format, FILE* fd_input, FILE* fd_output )
+void phasis( const std::string& accuracy, const std::string& output_data_format, FILE* fd_input, FILE* fd_output )
 {
-	if      ( output_data_format == "i8"  ) { phasis_<T,char>( fd_input, fd_output ); }
-	else if ( output_data_format == "i16" ) { phasis_<T,short>( fd_input, fd_output ); }
-	else if ( output_data_format == "i32" ) { phasis_<T,int>( fd_input, fd_output ); }
-	else if ( output_data_format == "f32" ) { phasis_<T,float>( fd_input, fd_output ); }
-	else if ( output_data_format == "f64" ) { phasis_<T,double>( fd_input, fd_output) ; }
+	if      ( output_data_format == "i8"  ) { phasis_<T,char>( accuracy, fd_input, fd_output ); }
+	else if ( output_data_format == "u8"  ) { phasis_<T,u8_sample>( accuracy, fd_input, fd_output ); }
+	else if ( output_data_format == "i16" ) { phasis_<T,short>( accuracy, fd_input, fd_output ); }
+	else if ( output_data_format == "i32" ) { phasis_<T,int>( accuracy, fd_input, fd_output ); }
+	else if ( output_data_format == "f16" ) { phasis_<T,f16_sample>( accuracy, fd_input, fd_output ); }
+	else if ( output_data_format == "f32" ) { phasis_<T,float>( accuracy, fd_input, fd_output ); }
+	else if ( output_data_format == "f64" ) { phasis_<T,double>( accuracy, fd_input, fd_output) ; }
 }
 
 int main(int argc, char** argv)
 {
 	if ( argc < 2 ) {
 		std::cerr << "Usage: " << argv[0] << " <OPTIONS>\n"
-			"  -d <INPUT_DATA_FORMAT> : i8 | i16 | i32 | f32 | f64 (default: i16)\n"
-			"  -D <OUTPUT_DATA_FORMAT> : i8 | i16 | i32 | f32 | f64 (default: f32)\n"
+			"  -d <INPUT_DATA_FORMAT> : i8 | u8 | i16 | i32 | f16 | f32 | f64 (default: i16)\n"
+			"  -D <OUTPUT_DATA_FORMAT> : i8 | u8 | i16 | i32 | f16 | f32 | f64 (default: f32)\n"
+			"  -a <ACCURACY> : fast (6.1e-4 rad) | accurate (2e-6 rad) | exact (default: exact)\n"
 			"  -i <INPUT_CAPTURE_FILE> (default: -)\n"
-			"  -o <OUTPUT_CAPTURE_FILE> (default: -)\n";
+			"  -o <OUTPUT_CAPTURE_FILE> (default: -)\n"
+			"  --stats-interval <SECONDS> : print the I/O and compute counters every SECONDS on stderr (default: on SIGUSR1 only)\n"
+			"  --stats-file <STATS_FILE> : rewrite the counters in STATS_FILE, every second by default\n";
 		return 1;
 	}
+	io_stats_start( argc, argv );
         const std::string prog_name = argv[0];
 	std::string data_format = "i16";
 	std::string output_data_format = "f32";
+	std::string accuracy = "exact";
 	const char* input_capture_file = "-";
 	const char* output_capture_file = "-";
 	for ( int i = 1; i < argc; i += 2 ) {
@@ -78,31 +95,47 @@ int main(int argc, char** argv)
 			data_format = argv[i+1];
 		} else if ( arg == "-D" ) {
 			output_data_format = argv[i+1];
+		} else if ( arg == "-a" ) {
+			accuracy = argv[i+1];
 		} else if ( arg == "-i" ) {
 			input_capture_file = argv[i+1];
 		} else if ( arg == "-o" ) {
 			output_capture_file = argv[i+1];
 		}
 	}
+	if ( data_format == "cu8" ) {
+		data_format = "u8";
+	}
 	if ( data_format != "i8" &&
+	     data_format != "u8" &&
 	     data_format != "i16" &&
 	     data_format != "i32" &&
+	     data_format != "f16" &&
 	     data_format != "f32" &&
 	     data_format != "f64" ) {
 		std::cerr << prog_name << " : ERROR: please set a valid data format !\n";
 		return 1;
 	}
+	if ( output_data_format == "cu8" ) {
+		output_data_format = "u8";
+	}
 	if ( output_data_format != "i8" &&
+	     output_data_format != "u8" &&
 	     output_data_format != "i16" &&
 	     output_data_format != "i32" &&
+	     output_data_format != "f16" &&
 	     output_data_format != "f32" &&
 	     output_data_format != "f64" ) {
 		std::cerr << prog_name << " : ERROR: please set a valid output data format !\n";
 		return 1;
 	}
+	if ( accuracy != "fast" && accuracy != "accurate" && accuracy != "exact" ) {
+		std::cerr << prog_name << " : ERROR: please set a valid accuracy !\n";
+		return 1;
+	}
         FILE* fd_input = stdin;
 	if ( input_capture_file != std::string("-") ) {
-		fd_input = fopen( input_capture_file, "rb" );
+		fd_input = capture_open( input_capture_file, "rb", data_format );
 		if ( fd_input == NULL ) {
 			std::cerr << prog_name << " : ";
 			perror("fopen()");
@@ -111,17 +144,19 @@ int main(int argc, char** argv)
 	}
 	FILE* fd_output = stdout;
 	if ( output_capture_file != std::string("-") ) {
-		fd_output = fopen( output_capture_file, "w+b" );
+		fd_output = capture_open( output_capture_file, "w+b", output_data_format );
 		if ( fd_output == NULL ) {
 			std::cerr << prog_name << " : ";
                      	perror("fopen()");
 			return 1;
 		}
 	}
-	if      ( data_format == "i8"  ) { phasis<char>( output_data_format, fd_input, fd_output); }
-	else if ( data_format == "i16" ) { phasis<short>( output_data_format, fd_input, fd_output); }
-	else if ( data_format == "i32" ) { phasis<int>( output_data_format, fd_input, fd_output); }
-	else if ( data_format == "f32" ) { phasis<float>( output_data_format, fd_input, fd_output); }
-	else if ( data_format == "f64" ) { phasis<double>( output_data_format, fd_input, fd_output); }
+	if      ( data_format == "i8"  ) { phasis<char>( accuracy, output_data_format, fd_input, fd_output); }
+	else if ( data_format == "u8"  ) { phasis<u8_sample>( accuracy, output_data_format, fd_input, fd_output); }
+	else if ( data_format == "i16" ) { phasis<short>( accuracy, output_data_format, fd_input, fd_output); }
+	else if ( data_format == "i32" ) { phasis<int>( accuracy, output_data_format, fd_input, fd_output); }
+	else if ( data_format == "f16" ) { phasis<f16_sample>( accuracy, output_data_format, fd_input, fd_output); }
+	else if ( data_format == "f32" ) { phasis<float>( accuracy, output_data_format, fd_input, fd_output); }
+	else if ( data_format == "f64" ) { phasis<double>( accuracy, output_data_format, fd_input, fd_output); }
 	return 0;
 }
@@ -0,0 +1,242 @@
+/*
+  ===========================================================================
+
+  Copyright (C) 2018 Emvivre
+
+  This file is part of IQ_PIPELINE.
+
+  IQ_PIPELINE is free software: you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation, either version 3 of the License, or
+  (at your option) any later version.
+
+  IQ_PIPELINE is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with IQ_PIPELINE.  If not, see <http://www.gnu.org/licenses/>.
+
+  ===========================================================================
+*/
+
+/*
+  Runs a chain of the toolbox programs in one process:
+
+    iq_pipeline iq_phasis -d u8 -D f32 ! iq_resample -t scalar ... ! iq_conv ...
+
+  Each program is compiled in here (iq_programs.h), its main() being run
+  by one thread per stage, with the same options as on the command line.
+  Two consecutive stages are linked in memory: the io_read() of the
+  reader copies the samples straight out of the buffer passed to
+  io_write() by the writer, which waits for them to be consumed. A sample
+  crosses each link with a single memcpy, without system call, and the
+  io_flush() of each block costs nothing.
+
+  The two streams of a link are attached to it as an io_endpoint, and are
+  also stdio streams of their own for the rest (fileno() fails on them,
+  fclose() ends them).
+*/
+
+#include "iq_programs.h"
+
+/*
+  Link between two stages: write() publishes the buffer of the writer and
+  waits until read() has copied all of it. Once the reader is gone, it
+  fails with EPIPE instead, the writer stage then seeing the end of its
+  input (io_write_failed()) and ending in turn, up the chain.
+*/
+class stage_link : public io_endpoint
+{
+public:
+	stage_link() : data( NULL ), len( 0 ), writer_closed( false ), reader_closed( false ) {}
+
+	ssize_t put( const char* buf, size_t size )
+	{
+		std::unique_lock<std::mutex> lock( m );
+		if ( reader_closed ) {
+			errno = EPIPE;
+			return -1;
+		}
+		data = buf;
+		len = size;
+		cv.notify_all();
+		cv.wait( lock, [this]{ return len == 0 || reader_closed; } );
+		if ( len > 0 ) {
+			len = 0;
+			errno = EPIPE;
+			return -1;
+		}
+		return size;
+	}
+
+	ssize_t get( char* buf, size_t size )
+	{
+		std::unique_lock<std::mutex> lock( m );
+		cv.wait( lock, [this]{ return len > 0 || writer_closed; } );
+		const size_t n = std::min( size, len );
+		std::memcpy( buf, data, n );
+		data += n;
+		len -= n;
+		if ( len == 0 ) {
+			cv.notify_all();
+		}
+		return n;
+	}
+
+	size_t read( void* buf, size_t size )
+	{
+		if ( !ready() ) {
+			io_drain_pipes();
+		}
+		size_t done = 0;
+		while ( done < size ) {
+			const ssize_t n = get( (char*) buf + done, size - done );
+			if ( n <= 0 ) {
+				break;
+			}
+			done += n;
+		}
+		return done;
+	}
+
+	bool write( const void* buf, size_t size )
+	{
+		return put( (const char*) buf, size ) >= 0;
+	}
+
+	void flush() {}
+
+	bool ready()
+	{
+		std::lock_guard<std::mutex> lock( m );
+		return len > 0 || writer_closed;
+	}
+
+	void close_writer()
+	{
+		std::lock_guard<std::mutex> lock( m );
+		writer_closed = true;
+		cv.notify_all();
+	}
+
+	void close_reader()
+	{
+		std::lock_guard<std::mutex> lock( m );
+		reader_closed = true;
+		cv.notify_all();
+	}
+
+private:
+	std::mutex m;
+	std::condition_variable cv;
+	const char* data;
+	size_t len;
+	bool writer_closed;
+	bool reader_closed;
+};
+
+
+static ssize_t link_write( void* cookie, const char* buf, size_t size ) { return ( (stage_link*) cookie )->put( buf, size ); }
+static ssize_t link_read( void* cookie, char* buf, size_t size ) { return ( (stage_link*) cookie )->get( buf, size ); }
+static int link_close_writer( void* cookie ) { ( (stage_link*) cookie )->close_writer(); return 0; }
+static int link_close_reader( void* cookie ) { ( (stage_link*) cookie )->close_reader(); return 0; }
+
+struct stage
+{
+	const stage_program* program;
+	std::vector<char*> argv;
+	FILE* fd_input;
+	FILE* fd_output;
+	int result;
+};
+
+static void run_stage( stage* s )
+{
+	stage_stdin = s->fd_input;
+	stage_stdout = s->fd_output;
+	s->result = s->program->main( s->argv.size() - 1, &s->argv[0] );
+	io_flush( s->fd_output );
+	if ( s->fd_output != stdout ) {
+		io_detach( s->fd_output );
+		fclose( s->fd_output );
+	}
+	if ( s->fd_input != stdin ) {
+		io_detach( s->fd_input );
+		fclose( s->fd_input );
+	}
+}
+
+int main(int argc, char** argv)
+{
+	if ( argc < 2 ) {
+		std::cerr << "Usage: " << argv[0] << " <PROGRAM> <OPTIONS> [ ! <PROGRAM> <OPTIONS> ... ]\n"
+			"  runs the chain of programs in one process, like PROGRAM <OPTIONS> | PROGRAM <OPTIONS> ...\n"
+			"  PROGRAM :";
+		for ( int p = 0; p < NB_STAGE_PROGRAM; p++ ) {
+			std::cerr << " " << STAGE_PROGRAMS[ p ].name;
+		}
+		std::cerr << "\n";
+		return 1;
+	}
+	const std::string prog_name = argv[0];
+	std::vector<stage> stages;
+	for ( int i = 1; i < argc; ) {
+		std::string name = argv[i];
+		if ( name.compare( 0, 3, "iq_" ) != 0 ) {
+			name = "iq_" + name;
+		}
+		int p = 0;
+		while ( p < NB_STAGE_PROGRAM && name != STAGE_PROGRAMS[ p ].name ) {
+			p++;
+		}
+		if ( p == NB_STAGE_PROGRAM ) {
+			std::cerr << prog_name << " : ERROR: please set a valid program instead of " << argv[i] << " !\n";
+			return 1;
+		}
+		stage s;
+		s.program = &STAGE_PROGRAMS[ p ];
+		s.argv.push_back( (char*) STAGE_PROGRAMS[ p ].name );
+		for ( i++; i < argc && std::string( argv[i] ) != "!" && std::string( argv[i] ) != "|"; i++ ) {
+			s.argv.push_back( argv[i] );
+		}
+		s.argv.push_back( NULL );
+		s.fd_input = stdin;
+		s.fd_output = stdout;
+		s.result = 0;
+		stages.push_back( s );
+		if ( i < argc && i + 1 == argc ) {
+			std::cerr << prog_name << " : ERROR: please set a program after the last " << argv[i] << " !\n";
+			return 1;
+		}
+		i++;
+	}
+	std::vector<stage_link*> links;
+	for ( unsigned int k = 0; k + 1 < stages.size(); k++ ) {
+		stage_link* l = new stage_link();
+		const cookie_io_functions_t writer = { NULL, link_write, NULL, link_close_writer };
+		const cookie_io_functions_t reader = { link_read, NULL, NULL, link_close_reader };
+		stages[ k ].fd_output = fopencookie( l, "w", writer );
+		stages[ k+1 ].fd_input = fopencookie( l, "r", reader );
+		setvbuf( stages[ k ].fd_output, NULL, _IONBF, 0 );
+		io_attach( stages[ k ].fd_output, l );
+		io_attach( stages[ k+1 ].fd_input, l );
+		links.push_back( l );
+	}
+	std::vector<std::thread> threads;
+	for ( unsigned int k = 0; k < stages.size(); k++ ) {
+		threads.push_back( std::thread( run_stage, &stages[ k ] ) );
+	}
+	int result = 0;
+	for ( unsigned int k = 0; k < stages.size(); k++ ) {
+		threads[ k ].join();
+		if ( stages[ k ].result != 0 && result == 0 ) {
+			result = stages[ k ].result;
+		}
+	}
+	for ( unsigned int k = 0; k < links.size(); k++ ) {
+		delete links[ k ];
+	}
+	return result;
+}
@@ -0,0 +1,147 @@
+/*
+  ===========================================================================
+
+  Copyright (C) 2018 Emvivre
+
+  This file is part of IQ_TOOLBOX.
+
+  IQ_TOOLBOX is free software: you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation, either version 3 of the License, or
+  (at your option) any later version.
+
+  IQ_TOOLBOX is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with IQ_TOOLBOX.  If not, see <http://www.gnu.org/licenses/>.
+
+  ===========================================================================
+*/
+
+#ifndef IQ_PROGRAMS_H
+#define IQ_PROGRAMS_H
+
+/*
+  The toolbox programs compiled in one binary, each one in its own
+  namespace, for iq_pipeline and iq_bench. The system and toolbox headers
+  are included first, so that the include guards leave their
+  declarations in the global namespace. The main() of a program is then
+  its stage_main(), reading stage_stdin and writing stage_stdout, which
+  are set by the thread running it.
+*/
+
+#include <iostream>
+#include <complex>
+#include <vector>
+#include <string>
+#include <deque>
+#include <algorithm>
+#include <limits>
+#include <type_traits>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <cmath>
+#include <errno.h>
+#include <stdint.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#endif
+#include "iq_u8.h"
+#include "iq_f16.h"
+#include "iq_capture.h"
+#include "iq_io.h"
+#include "iq_fir.h"
+#include "iq_fft.h"
+#include "iq_nco.h"
+#include "iq_iir.h"
+#include "iq_discriminator.h"
+#include "fir.h"
+
+static thread_local FILE* stage_stdin = NULL;
+static thread_local FILE* stage_stdout = NULL;
+#undef stdin
+#undef stdout
+#define stdin stage_stdin
+#define stdout stage_stdout
+#define main stage_main
+
+namespace iq_channelize {
+#include "iq_channelize.cpp"
+}
+namespace iq_conv {
+#include "iq_conv.cpp"
+}
+namespace iq_decimate {
+#include "iq_decimate.cpp"
+}
+namespace iq_deemphasis {
+#include "iq_deemphasis.cpp"
+}
+namespace iq_demodfreq {
+#include "iq_demodfreq.cpp"
+}
+namespace iq_filter {
+#include "iq_filter.cpp"
+}
+namespace iq_iir {
+#include "iq_iir.cpp"
+}
+namespace iq_mix {
+#include "iq_mix.cpp"
+}
+namespace iq_modfreq {
+#include "iq_modfreq.cpp"
+}
+namespace iq_normalize {
+#include "iq_normalize.cpp"
+}
+namespace iq_phasis {
+#include "iq_phasis.cpp"
+}
+namespace iq_preemphasis {
+#include "iq_preemphasis.cpp"
+}
+namespace iq_resample {
+#include "iq_resample.cpp"
+}
+
+#undef main
+#undef stdin
+#undef stdout
+#define stdin stdin
+#define stdout stdout
+
+struct stage_program
+{
+	const char* name;
+	int (*main)( int argc, char** argv );
+};
+
+static const stage_program STAGE_PROGRAMS[] = {
+	{ "iq_channelize", iq_channelize::stage_main },
+	{ "iq_conv", iq_conv::stage_main },
+	{ "iq_decimate", iq_decimate::stage_main },
+	{ "iq_deemphasis", iq_deemphasis::stage_main },
+	{ "iq_demodfreq", iq_demodfreq::stage_main },
+	{ "iq_filter", iq_filter::stage_main },
+	{ "iq_iir", iq_iir::stage_main },
+	{ "iq_mix", iq_mix::stage_main },
+	{ "iq_modfreq", iq_modfreq::stage_main },
+	{ "iq_normalize", iq_normalize::stage_main },
+	{ "iq_phasis", iq_phasis::stage_main },
+	{ "iq_preemphasis", iq_preemphasis::stage_main },
+	{ "iq_resample", iq_resample::stage_main }
+};
+static const int NB_STAGE_PROGRAM = sizeof(STAGE_PROGRAMS) / sizeof(*STAGE_PROGRAMS);
+
+#endif
@@ -0,0 +1,282 @@
+/*
+  ===========================================================================
+
+  Copyright (C) 2018 Emvivre
+
+  This file is part of IQ_RESAMPLE.
+
+  IQ_RESAMPLE is free software: you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation, either version 3 of the License, or
+  (at your option) any later version.
+
+  IQ_RESAMPLE is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with IQ_RESAMPLE.  If not, see <http://www.gnu.org/licenses/>.
+
+  ===========================================================================
+*/
+
+#include <iostream>
+#include <complex>
+#include <vector>
+#include <algorithm>
+#include "iq_u8.h"
+#include "iq_f16.h"
+#include "iq_capture.h"
+#include "iq_io.h"
+#include "fir.h"
+
+static const unsigned int BUFFER_LEN = 200000;
+static const unsigned int NB_COEF_PER_PHASE = 32;
+static const unsigned int MAX_NB_PHASE = 16384;
+
+static unsigned int gcd( unsigned int a, unsigned int b )
+{
+	while ( b != 0 ) {
+		unsigned int r = a % b;
+		a = b;
+		b = r;
+	}
+	return a;
+}
+
+/*
+  Rational L/M resampler: the prototype low-pass designed at L times the
+  input rate is split into L phases of NB_COEF_PER_PHASE coefficients, and
+  only the phase falling on each output sample is computed.
+*/
+template <class S>
+class polyphase_resampler
+{
+public:
+	polyphase_resampler( unsigned int up_rate, unsigned int down_rate, const std::vector<double>& coef )
+		: up_rate( up_rate ), down_rate( down_rate ), phase( 0 ), pos( NB_COEF_PER_PHASE - 1 ),
+		  hist( NB_COEF_PER_PHASE - 1, S(0) ), phase_coef( up_rate * NB_COEF_PER_PHASE )
+	{
+		for ( unsigned int p = 0; p < up_rate; p++ ) {
+			for ( unsigned int j = 0; j < NB_COEF_PER_PHASE; j++ ) {
+				phase_coef[ p * NB_COEF_PER_PHASE + j ] = coef[ p + ( NB_COEF_PER_PHASE - 1 - j ) * up_rate ];
+			}
+		}
+	}
+
+	/* out needs room for n * up_rate / down_rate + 1 samples */
+	unsigned int process( const S* in, unsigned int n, S* out )
+	{
+		buff.resize( hist.size() + n );
+		std::copy( hist.begin(), hist.end(), buff.begin() );
+		std::copy( in, in + n, buff.begin() + hist.size() );
+		unsigned int j = 0;
+		while ( pos < buff.size() ) {
+			const S* p = &buff[ pos + 1 - NB_COEF_PER_PHASE ];
+			const double* c = &phase_coef[ phase * NB_COEF_PER_PHASE ];
+			S avg(0);
+			for ( unsigned int k = 0; k < NB_COEF_PER_PHASE; k++ ) {
+				avg += c[ k ] * p[ k ];
+			}
+			out[ j++ ] = avg;
+			phase += down_rate;
+			pos += phase / up_rate;
+			phase %= up_rate;
+		}
+		pos -= n;
+		std::copy( buff.end() - hist.size(), buff.end(), hist.begin() );
+		return j;
+	}
+
+private:
+	unsigned int up_rate;
+	unsigned int down_rate;
+	unsigned int phase;
+	unsigned int pos;
+	std::vector<S> hist;
+	std::vector<S> buff;
+	std::vector<double> phase_coef;
+};
+
+static std::vector<double> prototype_gen( const unsigned int sample_rate, const unsigned int output_sample_rate, unsigned int up_rate )
+{
+	const unsigned int nb_coef = up_rate * NB_COEF_PER_PHASE;
+	std::vector<double> coef( nb_coef );
+	const double cutoff_frequency = 0.45 * std::min( sample_rate, output_sample_rate );
+	fir_gen( BLACKMAN_WINDOW_TYPE, nb_coef, double(up_rate) * sample_rate, cutoff_frequency, &coef[0], NULL, NULL );
+	double sum = 0;
+	for ( unsigned int i = 0; i < nb_coef; i++ ) {
+		sum += coef[ i ];
+	}
+	for ( unsigned int i = 0; i < nb_coef; i++ ) {
+		coef[ i ] *= up_rate / sum;
+	}
+	return coef;
+}
+
+template <class T>
+void resample_scalar( const unsigned int sample_rate, const unsigned int output_sample_rate, FILE* fd_input, FILE* fd_output )
+{
+	const unsigned int g = gcd( sample_rate, output_sample_rate );
+	const unsigned int up_rate = output_sample_rate / g;
+	const unsigned int down_rate = sample_rate / g;
+	polyphase_resampler<double> resampler( up_rate, down_rate, prototype_gen( sample_rate, output_sample_rate, up_rate ) );
+	const unsigned int out_len = (unsigned long long)BUFFER_LEN * up_rate / down_rate + 1;
+	T* in_buff = new T[ BUFFER_LEN ];
+	T* out_buff = new T[ out_len ];
+	double* x = new double[ BUFFER_LEN ];
+	double* y = new double[ out_len ];
+	unsigned int nb_sample_read;
+	while( (nb_sample_read = io_read( in_buff, sizeof(*in_buff), BUFFER_LEN, fd_input)) > 0 ) {
+		for ( unsigned int i = 0; i < nb_sample_read; i++ ) {
+			x[ i ] = in_buff[ i ];
+		}
+		unsigned int nb_output = resampler.process( x, nb_sample_read, y );
+		for ( unsigned int j = 0; j < nb_output; j++ ) {
+			out_buff[ j ] = y[ j ];
+		}
+		io_write( out_buff, sizeof(*out_buff), nb_output, fd_output );
+		io_flush( fd_output );
+	}
+	delete[] y;
+	delete[] x;
+	delete[] out_buff;
+	delete[] in_buff;
+}
+
+template <class T>
+void resample_iq( const unsigned int sample_rate, const unsigned int output_sample_rate, FILE* fd_input, FILE* fd_output )
+{
+	const unsigned int g = gcd( sample_rate, output_sample_rate );
+	const unsigned int up_rate = output_sample_rate / g;
+	const unsigned int down_rate = sample_rate / g;
+	polyphase_resampler< std::complex<double> > resampler( up_rate, down_rate, prototype_gen( sample_rate, output_sample_rate, up_rate ) );
+	const unsigned int out_len = (unsigned long long)BUFFER_LEN * up_rate / down_rate + 1;
+	T* in_buff = new T[ 2*BUFFER_LEN ];
+	T* out_buff = new T[ 2*out_len ];
+	std::complex<double>* x = new std::complex<double>[ BUFFER_LEN ];
+	std::complex<double>* y = new std::complex<double>[ out_len ];
+	unsigned int nb_sample_read;
+	while( (nb_sample_read = io_read( in_buff, 2*sizeof(*in_buff), BUFFER_LEN, fd_input)) > 0 ) {
+		for ( unsigned int i = 0; i < nb_sample_read; i++ ) {
+			x[ i ] = std::complex<double>( in_buff[ 2*i ], in_buff[ 2*i+1 ] );
+		}
+		unsigned int nb_output = resampler.process( x, nb_sample_read, y );
+		for ( unsigned int j = 0; j < nb_output; j++ ) {
+			out_buff[ 2*j ] = y[ j ].real();
+			out_buff[ 2*j+1 ] = y[ j ].imag();
+		}
+		io_write( out_buff, 2*sizeof(*out_buff), nb_output, fd_output );
+		io_flush( fd_output );
+	}
+	delete[] y;
+	delete[] x;
+	delete[] out_buff;
+	delete[] in_buff;
+}
+
+int main(int argc, char** argv)
+{
+	if ( argc < 2 ) {
+		std::cerr << "Usage: " << argv[0] << " <OPTIONS>\n"
+			"  -s <SAMPLE_RATE>\n"
+			"  -S <OUTPUT_SAMPLE_RATE>\n"
+			"  -t <SIGNAL_TYPE> : scalar | iq (default: iq)\n"
+			"  -d <DATA_FORMAT> : i8 | u8 | i16 | i32 | f16 | f32 | f64 (default: i16)\n"
+			"  -i <INPUT_CAPTURE_FILE> (default: -)\n"
+			"  -o <OUTPUT_CAPTURE_FILE> (default: -)\n"
+			"  --stats-interval <SECONDS> : print the I/O and compute counters every SECONDS on stderr (default: on SIGUSR1 only)\n"
+			"  --stats-file <STATS_FILE> : rewrite the counters in STATS_FILE, every second by default\n";
+		return 1;
+	}
+	io_stats_start( argc, argv );
+	const std::string prog_name = argv[0];
+	unsigned int sample_rate = 0;
+	unsigned int output_sample_rate = 0;
+	std::string data_format = "i16";
+	std::string signal_type = "iq";
+	const char* input_capture_file = "-";
+	const char* output_capture_file = "-";
+	for ( int i = 1; i < argc; i += 2 ) {
+		std::string arg = argv[i];
+		if ( arg == "-s" ) {
+			sample_rate = atof( argv[i+1] );
+		} else if ( arg == "-S" ) {
+			output_sample_rate = atof( argv[i+1] );
+		} else if ( arg == "-t" ) {
+			signal_type = argv[i+1];
+		} else if ( arg == "-d" ) {
+			data_format = argv[i+1];
+		} else if ( arg == "-i" ) {
+			input_capture_file = argv[i+1];
+		} else if ( arg == "-o" ) {
+			output_capture_file = argv[i+1];
+		}
+	}
+	if ( sample_rate == 0 ) {
+		std::cerr << prog_name << " : ERROR: please set a valid sample rate !\n";
+		return 1;
+	}
+	if ( output_sample_rate == 0 ) {
+		std::cerr << prog_name << " : ERROR: please set a valid output sample rate !\n";
+		return 1;
+	}
+	if ( output_sample_rate / gcd( sample_rate, output_sample_rate ) > MAX_NB_PHASE ) {
+		std::cerr << prog_name << " : ERROR: output / input sample rate ratio needs too many filter phases !\n";
+		return 1;
+	}
+	if ( data_format == "cu8" ) {
+		data_format = "u8";
+	}
+	if ( data_format != "i8" &&
+	     data_format != "u8" &&
+	     data_format != "i16" &&
+	     data_format != "i32" &&
+	     data_format != "f16" &&
+	     data_format != "f32" &&
+	     data_format != "f64" ) {
+		std::cerr << prog_name << " : ERROR: please set a valid data format !\n";
+		return 1;
+	}
+	if ( signal_type != "scalar" && signal_type != "iq" ) {
+		std::cerr << prog_name << " : ERROR: please set a valid signal type !\n";
+		return 1;
+	}
+	FILE* fd_input = stdin;
+	if ( input_capture_file != std::string("-") ) {
+		fd_input = capture_open( input_capture_file, "rb", data_format );
+		if ( fd_input == NULL ) {
+			std::cerr << prog_name << " : ";
+			perror("fopen()");
+			return 1;
+		}
+	}
+	FILE* fd_output = stdout;
+	if ( output_capture_file != std::string("-") ) {
+		fd_output = capture_open( output_capture_file, "w+b", data_format );
+		if ( fd_output == NULL ) {
+			std::cerr << prog_name << " : ";
+			perror("fopen()");
+			return 1;
+		}
+	}
+	if ( signal_type == "scalar" ) {
+		if      ( data_format == "i8"  ) { resample_scalar<char>( sample_rate, output_sample_rate, fd_input, fd_output); }
+		else if ( data_format == "u8"  ) { resample_scalar<u8_sample>( sample_rate, output_sample_rate, fd_input, fd_output); }
+		else if ( data_format == "i16" ) { resample_scalar<short>( sample_rate, output_sample_rate, fd_input, fd_output); }
+		else if ( data_format == "i32" ) { resample_scalar<int>( sample_rate, output_sample_rate, fd_input, fd_output); }
+		else if ( data_format == "f16" ) { resample_scalar<f16_sample>( sample_rate, output_sample_rate, fd_input, fd_output); }
+		else if ( data_format == "f32" ) { resample_scalar<float>( sample_rate, output_sample_rate, fd_input, fd_output); }
+		else if ( data_format == "f64" ) { resample_scalar<double>( sample_rate, output_sample_rate, fd_input, fd_output); }
+	} else {
+		if      ( data_format == "i8"  ) { resample_iq<char>( sample_rate, output_sample_rate, fd_input, fd_output); }
+		else if ( data_format == "u8"  ) { resample_iq<u8_sample>( sample_rate, output_sample_rate, fd_input, fd_output); }
+		else if ( data_format == "i16" ) { resample_iq<short>( sample_rate, output_sample_rate, fd_input, fd_output); }
+		else if ( data_format == "i32" ) { resample_iq<int>( sample_rate, output_sample_rate, fd_input, fd_output); }
+		else if ( data_format == "f16" ) { resample_iq<f16_sample>( sample_rate, output_sample_rate, fd_input, fd_output); }
+		else if ( data_format == "f32" ) { resample_iq<float>( sample_rate, output_sample_rate, fd_input, fd_output); }
+		else if ( data_format == "f64" ) { resample_iq<double>( sample_rate, output_sample_rate, fd_input, fd_output); }
+	}
+	return 0;
+}
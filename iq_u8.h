@@ -0,0 +1,67 @@
+/*
+  ===========================================================================
+
+  Copyright (C) 2018 Emvivre
+
+  This file is part of IQ_TOOLBOX.
+
+  IQ_TOOLBOX is free software: you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation, either version 3 of the License, or
+  (at your option) any later version.
+
+  IQ_TOOLBOX is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with IQ_TOOLBOX.  If not, see <http://www.gnu.org/licenses/>.
+
+  ===========================================================================
+*/
+
+#ifndef IQ_U8_H
+#define IQ_U8_H
+
+#include <cmath>
+#include <limits>
+
+/*
+  Unsigned 8 bit offset binary sample, as written by rtl_sdr: the byte b
+  stands for the value b - 128, so that the range is the one of i8. It
+  converts to and from the arithmetic types like the other formats, the
+  values written being truncated then saturated to [ -128, 127 ].
+*/
+class u8_sample
+{
+public:
+	u8_sample() {}
+	explicit u8_sample( double x ) { *this = x; }
+
+	u8_sample& operator=( double x )
+	{
+		const double v = std::trunc( x );
+		b = ( v >= 127 ) ? 255 : ( v <= -128 ) ? 0 : (unsigned char)( int( v ) + 128 );
+		return *this;
+	}
+
+	operator double() const { return int( b ) - 128; }
+
+	unsigned char byte() const { return b; }
+
+private:
+	unsigned char b;
+};
+
+namespace std {
+template <> class numeric_limits<u8_sample> : public numeric_limits<signed char>
+{
+public:
+	static u8_sample min() { return u8_sample( -128 ); }
+	static u8_sample max() { return u8_sample( 127 ); }
+	static u8_sample lowest() { return u8_sample( -128 ); }
+};
+}
+
+#endif
@@ -0,0 +1,100 @@
+#!/usr/bin/python3
+# -*- coding: utf-8 -*-
+# -*- mode: Python -*-
+
+"""
+  ===========================================================================
+
+  Copyright (C) 2018 Emvivre
+
+  This file is part of IQ_TOOLBOX.
+
+  IQ_TOOLBOX is free software: you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation, either version 3 of the License, or
+  (at your option) any later version.
+
+  IQ_TOOLBOX is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with IQ_TOOLBOX.  If not, see <http://www.gnu.org/licenses/>.
+
+  ===========================================================================
+"""
+
+# A capture written to a .iqz container by iq_conv must be read back
+# unchanged, through packed blocks (a slow signal) as well as raw ones
+# (noise). A corrupted container must be refused or cut short at the
+# corrupted block, never decoded past its payload: the tool has to end by
+# itself, with no more samples than the capture holds.
+
+import math
+import os
+import random
+import struct
+import subprocess
+import sys
+import tempfile
+
+IQ_CONV = os.path.join( os.path.dirname( os.path.abspath( __file__ ) ), '..', 'bin', 'iq_conv' )
+
+HEADER_SIZE = 24
+RECORD_SIZE = 9
+
+def conv( fmt, args, data = b'' ):
+    return subprocess.run( [ IQ_CONV, '-d', fmt, '-D', fmt ] + args, input = data, stdout = subprocess.PIPE, stderr = subprocess.PIPE )
+
+def samples( nb_sample ):
+    rng = random.Random( 1 )
+    x = []
+    for k in range( nb_sample ):
+        if k < nb_sample // 2:
+            x.append( int( 3000 * math.sin( 0.001 * k ) ) )
+        else:
+            x.append( rng.randint( -32768, 32767 ) )
+    return struct.pack( '<%dh' % nb_sample, *x )
+
+def check_round_trip( path, data ):
+    w = conv( 'i16', [ '-o', path ], data )
+    if w.returncode != 0:
+        print( 'round trip: the writer failed with status %d' % w.returncode )
+        return False
+    r = conv( 'i16', [ '-i', path ] )
+    if r.returncode != 0 or r.stdout != data:
+        print( 'round trip: %d bytes read back for %d, status %d' % ( len( r.stdout ), len( data ), r.returncode ) )
+        return False
+    return True
+
+def check_corrupted( name, path, data, offset, value ):
+    with open( path, 'rb' ) as f:
+        z = bytearray( f.read() )
+    z[ offset : offset + len( value ) ] = value
+    bad = path + '.bad.iqz'
+    with open( bad, 'wb' ) as f:
+        f.write( z )
+    r = conv( 'i16', [ '-i', bad ] )
+    os.remove( bad )
+    if r.returncode < 0:
+        print( '%s: killed by signal %d' % ( name, -r.returncode ) )
+        return False
+    if len( r.stdout ) >= len( data ) or r.stderr == b'':
+        print( '%s: %d bytes read for %d, without any error' % ( name, len( r.stdout ), len( data ) ) )
+        return False
+    return True
+
+ok = True
+data = samples( 200000 )
+with tempfile.TemporaryDirectory() as d:
+    path = os.path.join( d, 'capture.iqz' )
+    ok = check_round_trip( path, data ) and ok
+    payload = HEADER_SIZE + RECORD_SIZE
+    for name, offset, value in [ ( 'width byte out of the lane', payload, b'\xc8' ),
+                                 ( 'payload shorter than its groups', HEADER_SIZE + 4, struct.pack( '<I', 4 ) ),
+                                 ( 'block length of 0', 8, struct.pack( '<I', 0 ) ),
+                                 ( 'block length too long', 8, struct.pack( '<I', 1 << 30 ) ) ]:
+        ok = check_corrupted( name, path, data, offset, value ) and ok
+print( 'iqz container: %s' % ( 'ok' if ok else 'FAILED' ) )
+sys.exit( 0 if ok else 1 )
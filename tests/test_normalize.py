@@ -0,0 +1,86 @@
+#!/usr/bin/python3
+# -*- coding: utf-8 -*-
+# -*- mode: Python -*-
+
+"""
+  ===========================================================================
+
+  Copyright (C) 2018 Emvivre
+
+  This file is part of IQ_TOOLBOX.
+
+  IQ_TOOLBOX is free software: you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation, either version 3 of the License, or
+  (at your option) any later version.
+
+  IQ_TOOLBOX is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with IQ_TOOLBOX.  If not, see <http://www.gnu.org/licenses/>.
+
+  ===========================================================================
+"""
+
+# The look ahead of the AGC of iq_normalize delays the signal without
+# shifting it: on a signal of constant magnitude the gain is constant, so
+# the output must be the input scaled, frame for frame, with the same
+# number of frames. And the gain must already be lowered when a burst
+# leaves the delay line, whether the look ahead is shorter or longer than
+# the window: the peak AGC output then never goes past its maximum.
+
+import math
+import os
+import struct
+import subprocess
+import sys
+
+IQ_NORMALIZE = os.path.join( os.path.dirname( os.path.abspath( __file__ ) ), '..', 'bin', 'iq_normalize' )
+
+def run( args, samples ):
+    data = struct.pack( '<%dd' % len( samples ), *samples )
+    out = subprocess.run( [ IQ_NORMALIZE ] + args, input = data, stdout = subprocess.PIPE, check = True ).stdout
+    return list( struct.unpack( '<%dd' % ( len( out ) // 8 ), out ) )
+
+def check( mode, nb_frame, look_ahead ):
+    x = []
+    for k in range( nb_frame ):
+        x += [ math.cos( 0.01 * k ), math.sin( 0.01 * k ) ]
+    y = run( [ '-t', 'iq', '-d', 'f64', '-a', mode, '-m', '2', '-w', '16', '-l', str( look_ahead ) ], x )
+    name = '%s, %d frames, look ahead %d' % ( mode, nb_frame, look_ahead )
+    if len( y ) != len( x ):
+        print( '%s: %d samples out for %d in' % ( name, len( y ), len( x ) ) )
+        return False
+    for i in range( len( x ) ):
+        if abs( y[ i ] - 2 * x[ i ] ) > 1e-9:
+            print( '%s: sample %d is %g instead of %g' % ( name, i, y[ i ], 2 * x[ i ] ) )
+            return False
+    return True
+
+def check_burst( window, look_ahead ):
+    x = []
+    for k in range( 2000 ):
+        a = 100 if 1000 <= k < 1020 else 1
+        x += [ a * math.cos( 0.01 * k ), a * math.sin( 0.01 * k ) ]
+    y = run( [ '-t', 'iq', '-d', 'f64', '-a', 'peak', '-m', '1', '-w', str( window ), '-l', str( look_ahead ) ], x )
+    name = 'peak burst, window %d, look ahead %d' % ( window, look_ahead )
+    if len( y ) != len( x ):
+        print( '%s: %d samples out for %d in' % ( name, len( y ), len( x ) ) )
+        return False
+    peak = max( math.hypot( y[ 2*i ], y[ 2*i+1 ] ) for i in range( len( y ) // 2 ) )
+    if peak > 1 + 1e-9:
+        print( '%s: output peak %g above 1' % ( name, peak ) )
+        return False
+    return True
+
+ok = True
+for mode in [ 'peak', 'rms' ]:
+    for nb_frame, look_ahead in [ ( 1000, 0 ), ( 1000, 1 ), ( 1000, 100 ), ( 50, 100 ), ( 45000, 25000 ) ]:
+        ok = check( mode, nb_frame, look_ahead ) and ok
+for window, look_ahead in [ ( 16, 8 ), ( 16, 16 ), ( 16, 100 ), ( 256, 100 ), ( 1, 1000 ) ]:
+    ok = check_burst( window, look_ahead ) and ok
+print( 'normalize look ahead: %s' % ( 'ok' if ok else 'FAILED' ) )
+sys.exit( 0 if ok else 1 )